@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -50,6 +51,8 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+
+  struct evwatch *watch;  // event queues watching the console
 } cons;
 
 //
@@ -58,20 +61,30 @@ struct {
 int
 consolewrite(int user_src, uint64 src, int n)
 {
-  int i;
-
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++){
-    char c;
-    if(either_copyin(&c, user_src, src+i, 1) == -1)
+  char buf[128];
+  int i, m;
+
+  // no cons.lock: uartwrite() may sleep for room, and
+  // either_copyin() may need to swap the page in.
+  // uart_tx_lock keeps each chunk together.
+  for(i = 0; i < n; i += m){
+    m = n - i < sizeof(buf) ? n - i : sizeof(buf);
+    if(either_copyin(buf, user_src, src+i, m) == -1)
       break;
-    uartputc(c);
+    uartwrite(buf, m);
   }
-  release(&cons.lock);
 
   return i;
 }
 
+// reads block until a whole line has been typed;
+// writes never do. cons.lock must be held.
+static int
+consolestate(void)
+{
+  return cons.r != cons.w ? POLLIN|POLLOUT : POLLOUT;
+}
+
 //
 // user read()s from the console go here.
 // copy (up to) a whole input line to dst.
@@ -123,11 +136,29 @@ consoleread(int user_dst, uint64 dst, int n)
       break;
     }
   }
+  evnotify(&cons.watch, consolestate());
   release(&cons.lock);
 
   return target - n;
 }
 
+int
+consolepoll(void)
+{
+  int r;
+
+  acquire(&cons.lock);
+  r = consolestate();
+  release(&cons.lock);
+  return r;
+}
+
+struct evwatch**
+consolewatches(void)
+{
+  return &cons.watch;
+}
+
 //
 // the console input interrupt handler.
 // uartintr() calls this for input character.
@@ -172,6 +203,8 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwakeup();
+        evnotify(&cons.watch, consolestate());
       }
     }
     break;
@@ -191,4 +224,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
@@ -1,13 +1,18 @@
 struct buf;
 struct context;
+struct evq;
+struct evwatch;
 struct file;
 struct inode;
+struct kcache;
 struct pipe;
+struct pollfd;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct uclock;
 
 // bio.c
 void            binit(void);
@@ -20,10 +25,24 @@ void            bunpin(struct buf*);
 // console.c
 void            consoleinit(void);
 void            consoleintr(int);
+int             consolepoll(void);
+struct evwatch** consolewatches(void);
+
+// evq.c
+void            evinit(void);
+struct evq*     evqalloc(void);
+void            evqclose(struct evq*);
+void            evforget(struct file*);
+void            evnotify(struct evwatch**, int);
+int             evctl(struct evq*, int, struct file*, int, int);
+int             evwait(struct evq*, struct pollfd*, int, int);
+int             evqpoll(struct evq*);
+void            evtick(void);
 void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -33,6 +52,13 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filesplice(struct file*, struct file*, int);
+int             filepoll(struct file*);
+uint            pollbegin(void);
+void            pollwait(uint, int, uint);
+void            pollend(void);
+void            pollwakeup(void);
+void            polltick(void);
 
 // fs.c
 void            fsinit(int);
@@ -62,7 +88,33 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+void            kref(void *);
 void            kinit(void);
+void*           kallocpages(int);
+void*           kalloc_zeroed(void);
+int             kzerofill(void);
+void            kmemstat(uint64*, uint64*);
+void            kfreepages(void *, int);
+void*           kallocmega(void);
+void            kfreemega(void *);
+
+// shm.c
+void            shminit(void);
+uint64          shmmap(int, int);
+int             shmunmap(int);
+int             shmfork(struct proc*, struct proc*);
+void            shmunmapall(struct proc*, pagetable_t);
+
+// uring.c
+uint64          uringsetup(void);
+void            uringfree(struct proc*, pagetable_t);
+int             uringenter(int);
+
+// slab.c
+void            kcacheinit(struct kcache*, char*, uint);
+void*           kcachealloc(struct kcache*);
+void            kcachefree(struct kcache*, void*);
+int             kcachereclaim(void);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -71,15 +123,24 @@ void            begin_op(void);
 void            end_op(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, uint64, int);
-int             pipewrite(struct pipe*, uint64, int);
+int             piperead(struct pipe*, uint64, int, int);
+int             pipewrite(struct pipe*, uint64, int, int);
+int             pipepoll(struct pipe*);
+struct evwatch** pipewatches(struct pipe*);
+int             pipewbegin(struct pipe*, char**, int);
+void            pipewend(struct pipe*, int);
+int             piperbegin(struct pipe*, char**, int);
+void            piperend(struct pipe*, int);
 
 // printf.c
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
+void            klogdrain(void);
+int             klogread(uint64, int);
 
 // proc.c
 int             cpuid(void);
@@ -104,6 +165,19 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             procinfo(uint64, int);
+int             setaffinity(uint64);
+extern uint64   schedlat[];
+int             spawn(char*, char**, struct file**);
+int             nproc(void);
+
+// swap.c
+void            swapinit(struct superblock*);
+int             swapout(void);
+int             swapin(struct proc*, uint64);
+void            swapinrange(uint64, uint64);
+void            swapread(void*, uint);
+void            swapfree(uint);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -144,13 +218,20 @@ extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
+extern struct uclock *uclock;
 void            usertrapret(void);
+int             nanosleep(uint64);
+void            clockidle(int);
+void            sendipi(int);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartwrite(char*, int);
+int             uartputs(char*, int);
 void            uartputc_sync(int);
+void            uartflush(void);
 int             uartgetc(void);
 
 // vm.c
@@ -158,7 +239,12 @@ void            kvminit(void);
 void            kvminithart(void);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
+pagetable_t     kvmcreate(void);
+void            kvmsyncuser(struct proc*);
+int             asidbits(void);
+void            kvmfree(pagetable_t);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
+int             mapmegapages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
@@ -167,6 +253,9 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+uint64          uvmclock(pagetable_t, uint64, uint64);
+uint64          uvmresident(pagetable_t, uint64, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
@@ -181,6 +270,7 @@ void            plic_complete(int);
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
+void            virtio_disk_rwpage(void *, uint, int);
 void            virtio_disk_intr(void);
 
 // number of elements in fixed-size array
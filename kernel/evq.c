@@ -0,0 +1,354 @@
+//
+// Event queues: a persistent set of watched file descriptors,
+// like poll() but without handing the whole set to the kernel
+// on every call.
+//
+// Each watch is on two lists: its queue's, and the watched
+// object's (a pipe's, or the console's). When the object's
+// state changes, it calls evnotify() with its new POLL flags,
+// which records them in each of its watches and puts the ready
+// ones on their queue's ready list. evwait() only looks at the
+// ready list, so it costs time in proportion to the number of
+// ready descriptors, not watched ones. Readiness is level
+// triggered: a watch stays on the ready list until a
+// notification says it is no longer ready.
+//
+// Only pipes and the console can be watched; disk files are
+// always ready.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "slab.h"
+#include "poll.h"
+
+struct evwatch {
+  struct evq *q;
+  struct file *f;          // watched file
+  int fd;                  // the user's name for it
+  int events;              // POLLIN/POLLOUT wanted, and POLLHUP
+  int revents;             // what the object last said applies
+  uint gen;                // bumped by each notification
+  int ready;               // on q's ready list
+  struct evwatch **olist;  // the object's list
+  struct evwatch *onext;   // on the object's list
+  struct evwatch *qnext;   // on q's list of watches
+  struct evwatch *rnext;   // on q's ready list
+};
+
+struct evq {
+  struct evwatch *watches;
+  struct evwatch *rhead;   // ready list
+  struct evwatch *rtail;
+  int nready;
+  int ntimed;              // evwait()s with a timeout
+};
+
+// one lock for all queues and watch lists. objects call
+// evnotify() with their own lock held, so it must not be held
+// while calling into them.
+struct {
+  struct spinlock lock;
+  struct kcache qcache;
+  struct kcache wcache;
+  int ntimed;              // evwait()s with a timeout, in all queues
+  int timed;               // is deadline set?
+  uint deadline;           // earliest evwait() timeout, in ticks
+} ev;
+
+void
+evinit(void)
+{
+  initlock(&ev.lock, "evq");
+  kcacheinit(&ev.qcache, "evq", sizeof(struct evq));
+  kcacheinit(&ev.wcache, "evwatch", sizeof(struct evwatch));
+}
+
+// the list of watches on the object behind f, or 0 if f
+// can't be watched.
+static struct evwatch**
+objlist(struct file *f)
+{
+  if(f->type == FD_PIPE)
+    return pipewatches(f->pipe);
+  if(f->type == FD_DEVICE && f->major == CONSOLE)
+    return consolewatches();
+  return 0;
+}
+
+static void
+enqueue(struct evq *q, struct evwatch *w)
+{
+  w->rnext = 0;
+  if(q->rtail)
+    q->rtail->rnext = w;
+  else
+    q->rhead = w;
+  q->rtail = w;
+  q->nready++;
+  w->ready = 1;
+}
+
+static struct evwatch*
+dequeue(struct evq *q)
+{
+  struct evwatch *w = q->rhead;
+
+  q->rhead = w->rnext;
+  if(q->rhead == 0)
+    q->rtail = 0;
+  q->nready--;
+  w->ready = 0;
+  return w;
+}
+
+// set w's state, and queue it if ready. ev.lock must be held.
+static void
+update(struct evwatch *w, int revents)
+{
+  w->revents = revents & w->events;
+  if(w->revents && !w->ready){
+    enqueue(w->q, w);
+    wakeup(w->q);
+    if(w->q->ntimed)
+      wakeup(&ev.ntimed);
+  }
+}
+
+// Take w off every list and free it. ev.lock must be held.
+static void
+unwatch(struct evwatch *w)
+{
+  struct evwatch **pp;
+  struct evq *q = w->q;
+  int i, n;
+
+  for(pp = w->olist; *pp != w; pp = &(*pp)->onext)
+    ;
+  *pp = w->onext;
+  for(pp = &q->watches; *pp != w; pp = &(*pp)->qnext)
+    ;
+  *pp = w->qnext;
+  if(w->ready){
+    // rotate the ready list, leaving w out.
+    n = q->nready;
+    for(i = 0; i < n; i++){
+      struct evwatch *x = dequeue(q);
+      if(x != w)
+        enqueue(q, x);
+    }
+  }
+  kcachefree(&ev.wcache, w);
+}
+
+// An object's state changed to revents: tell its watchers.
+// Called with the object's lock held.
+void
+evnotify(struct evwatch **list, int revents)
+{
+  struct evwatch *w;
+
+  __sync_synchronize();
+  if(*list == 0)
+    return;
+  acquire(&ev.lock);
+  for(w = *list; w; w = w->onext){
+    w->gen++;
+    update(w, revents);
+  }
+  release(&ev.lock);
+}
+
+struct evq*
+evqalloc(void)
+{
+  struct evq *q;
+
+  if((q = kcachealloc(&ev.qcache)) == 0)
+    return 0;
+  memset(q, 0, sizeof(*q));
+  return q;
+}
+
+// the last reference to q's file is gone.
+void
+evqclose(struct evq *q)
+{
+  acquire(&ev.lock);
+  while(q->watches)
+    unwatch(q->watches);
+  release(&ev.lock);
+  kcachefree(&ev.qcache, q);
+}
+
+// f is being closed for good: drop all watches on it.
+void
+evforget(struct file *f)
+{
+  struct evwatch **list, *w;
+
+  // no one can add a watch to f now.
+  if((list = objlist(f)) == 0 || *list == 0)
+    return;
+  acquire(&ev.lock);
+  for(w = *list; w; ){
+    struct evwatch *next = w->onext;
+    if(w->f == f)
+      unwatch(w);
+    w = next;
+  }
+  release(&ev.lock);
+}
+
+static struct evwatch*
+lookup(struct evq *q, struct file *f, int fd)
+{
+  struct evwatch *w;
+
+  for(w = q->watches; w; w = w->qnext)
+    if(w->f == f && w->fd == fd)
+      return w;
+  return 0;
+}
+
+// Add, change or remove the watch on f, known to the user as
+// fd. Returns 0, or -1 if f can't be watched or the watch
+// doesn't exist (EV_MOD, EV_DEL) or already does (EV_ADD).
+int
+evctl(struct evq *q, int op, struct file *f, int fd, int events)
+{
+  struct evwatch **list, *w;
+  uint gen;
+  int r;
+
+  if((list = objlist(f)) == 0)
+    return -1;
+  events = (events & (POLLIN|POLLOUT)) | POLLHUP;
+  if(!f->readable)
+    events &= ~POLLIN;
+  if(!f->writable)
+    events &= ~POLLOUT;
+
+  acquire(&ev.lock);
+  w = lookup(q, f, fd);
+  if(op == EV_DEL && w){
+    unwatch(w);
+    release(&ev.lock);
+    return 0;
+  }
+  if(op == EV_ADD && w == 0){
+    if((w = kcachealloc(&ev.wcache)) == 0){
+      release(&ev.lock);
+      return -1;
+    }
+    memset(w, 0, sizeof(*w));
+    w->q = q;
+    w->f = f;
+    w->fd = fd;
+    w->olist = list;
+    w->onext = *list;
+    *list = w;
+    w->qnext = q->watches;
+    q->watches = w;
+  } else if(op != EV_MOD || w == 0){
+    release(&ev.lock);
+    return -1;
+  }
+  w->events = events;
+  gen = w->gen;
+  release(&ev.lock);
+
+  // the object's current state, unless it notifies a newer
+  // one meanwhile. look w up again, in case another process
+  // sharing q removed it.
+  r = filepoll(f);
+  acquire(&ev.lock);
+  if((w = lookup(q, f, fd)) != 0 && w->gen == gen)
+    update(w, r);
+  release(&ev.lock);
+  return 0;
+}
+
+// Wait for ready watches, for up to timeout ticks (forever if
+// negative), and describe up to max of them in out[]. Returns
+// how many, or -1 if killed. Ready watches are reported in
+// turn, so none starves if more than max are ready.
+int
+evwait(struct evq *q, struct pollfd *out, int max, int timeout)
+{
+  struct proc *p = myproc();
+  struct evwatch *w;
+  uint start = ticks, deadline = start + timeout;
+  int i, n, len;
+
+  acquire(&ev.lock);
+  for(;;){
+    n = 0;
+    len = q->nready;
+    for(i = 0; i < len && n < max; i++){
+      w = dequeue(q);
+      if(w->revents == 0)
+        continue;
+      out[n].fd = w->fd;
+      out[n].events = w->events;
+      out[n].revents = w->revents;
+      n++;
+      enqueue(q, w);
+    }
+    if(n > 0 || timeout == 0 || (timeout > 0 && ticks - start >= timeout) ||
+       p->killed)
+      break;
+    if(timeout > 0){
+      // woken by the clock, once the earliest deadline
+      // is due, as well as by notifications.
+      if(!ev.timed || (int)(deadline - ev.deadline) < 0){
+        ev.timed = 1;
+        ev.deadline = deadline;
+      }
+      q->ntimed++;
+      ev.ntimed++;
+      sleep(&ev.ntimed, &ev.lock);
+      ev.ntimed--;
+      q->ntimed--;
+    } else {
+      sleep(q, &ev.lock);
+    }
+  }
+  release(&ev.lock);
+  return p->killed ? -1 : n;
+}
+
+// POLLIN if q has ready watches.
+int
+evqpoll(struct evq *q)
+{
+  int r;
+
+  acquire(&ev.lock);
+  r = q->nready ? POLLIN : 0;
+  release(&ev.lock);
+  return r;
+}
+
+// Called every tick: wake evwait()s with timeouts if the
+// earliest is due. Those still waiting set the next one.
+void
+evtick(void)
+{
+  __sync_synchronize();
+  if(ev.timed == 0)
+    return;
+  acquire(&ev.lock);
+  if(ev.timed && (int)(ticks - ev.deadline) >= 0){
+    ev.timed = 0;
+    wakeup(&ev.ntimed);
+  }
+  release(&ev.lock);
+}
@@ -12,17 +12,34 @@
 #include "file.h"
 #include "stat.h"
 #include "proc.h"
+#include "slab.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  int nfile;           // allocated files, at most NFILE
+  struct kcache cache; // struct file allocator
 } ftable;
 
+// poll() sleeps until something might have made a descriptor
+// ready: pipes and the console call pollwakeup() whenever
+// their state changes, and the clock calls polltick() every
+// tick, which wakes them only once the earliest timeout is due.
+struct {
+  struct spinlock lock;
+  uint seq;       // bumped by every pollwakeup()
+  int nwait;      // processes in poll()
+  int timed;      // is deadline set?
+  uint deadline;  // earliest timeout of a sleeping poll(), in ticks
+} pollq;
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  initlock(&pollq.lock, "poll");
+  kcacheinit(&ftable.cache, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -32,15 +49,22 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.nfile >= NFILE){
+    release(&ftable.lock);
+    return 0;
   }
+  ftable.nfile++;
   release(&ftable.lock);
-  return 0;
+
+  if((f = kcachealloc(&ftable.cache)) == 0){
+    acquire(&ftable.lock);
+    ftable.nfile--;
+    release(&ftable.lock);
+    return 0;
+  }
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -70,10 +94,15 @@ fileclose(struct file *f)
   }
   ff = *f;
   f->ref = 0;
-  f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  evforget(f);
+  f->type = FD_NONE;
+  kcachefree(&ftable.cache, f);
 
-  if(ff.type == FD_PIPE){
+  if(ff.type == FD_EVENTQ){
+    evqclose(ff.evq);
+  } else if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
   } else if(ff.type == FD_INODE || ff.type == FD_DEVICE){
     begin_op();
@@ -111,17 +140,25 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->readable == 0)
     return -1;
 
+  // pipes and devices copy out with a spinlock held,
+  // so they can't fault pages in from swap themselves.
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    swapinrange(addr, n);
+    r = piperead(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
+    if(f->nonblock && devsw[f->major].poll && !(devsw[f->major].poll() & POLLIN))
+      return -1;
+    swapinrange(addr, n);
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
     if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
+  } else if(f->type == FD_EVENTQ){
+    r = -1;
   } else {
     panic("fileread");
   }
@@ -140,10 +177,14 @@ filewrite(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    swapinrange(addr, n);
+    ret = pipewrite(f->pipe, addr, n, f->nonblock);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
+    if(f->nonblock && devsw[f->major].poll && !(devsw[f->major].poll() & POLLOUT))
+      return -1;
+    swapinrange(addr, n);
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
@@ -173,6 +214,8 @@ filewrite(struct file *f, uint64 addr, int n)
       i += r;
     }
     ret = (i == n ? n : -1);
+  } else if(f->type == FD_EVENTQ){
+    ret = -1;
   } else {
     panic("filewrite");
   }
@@ -180,3 +223,193 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// Append n bytes at kernel address src to inode file f, a few
+// blocks per transaction, as filewrite() does.
+// Returns the number of bytes written.
+static int
+inodewrite(struct file *f, char *src, int n)
+{
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i, n1, r;
+
+  for(i = 0; i < n; i += r){
+    n1 = n - i;
+    if(n1 > max)
+      n1 = max;
+    begin_op();
+    ilock(f->ip);
+    if((r = writei(f->ip, 0, (uint64)(src + i), f->off, n1)) > 0)
+      f->off += r;
+    iunlock(f->ip);
+    end_op();
+    if(r != n1)
+      return r < 0 ? i : i + r;
+  }
+  return i;
+}
+
+// Read up to n bytes from inode file f into kernel address dst.
+static int
+inoderead(struct file *f, char *dst, int n)
+{
+  int r;
+
+  ilock(f->ip);
+  if((r = readi(f->ip, 0, (uint64)dst, f->off, n)) > 0)
+    f->off += r;
+  iunlock(f->ip);
+  return r;
+}
+
+// Move up to n bytes from file in to file out inside the kernel,
+// between a file and a pipe, or between two files. Data from
+// or to a pipe is read or written in the pipe's own buffer.
+// Returns the number of bytes moved, or -1.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  int m, r, tot = 0;
+  char *buf;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    while(tot < n){
+      if((m = pipewbegin(out->pipe, &buf, n - tot)) < 0)
+        return tot > 0 ? tot : -1;
+      r = inoderead(in, buf, m);
+      pipewend(out->pipe, r > 0 ? r : 0);
+      if(r <= 0)
+        break;
+      tot += r;
+    }
+  } else if(in->type == FD_PIPE && out->type == FD_INODE){
+    while(tot < n){
+      if((m = piperbegin(in->pipe, &buf, n - tot)) <= 0){
+        if(m < 0 && tot == 0)
+          return -1;
+        break;
+      }
+      r = inodewrite(out, buf, m);
+      piperend(in->pipe, r);
+      tot += r;
+      if(r != m)
+        break;
+    }
+  } else if(in->type == FD_INODE && out->type == FD_INODE){
+    // no buffer to borrow: bounce through a page.
+    if((buf = kalloc()) == 0)
+      return -1;
+    while(tot < n){
+      m = n - tot < PGSIZE ? n - tot : PGSIZE;
+      if((r = inoderead(in, buf, m)) <= 0)
+        break;
+      m = inodewrite(out, buf, r);
+      tot += m;
+      if(m != r)
+        break;
+    }
+    kfree(buf);
+  } else {
+    return -1;
+  }
+  return tot;
+}
+
+// Which of POLLIN, POLLOUT and POLLHUP apply to f now.
+// Files on disk never block.
+int
+filepoll(struct file *f)
+{
+  int r;
+
+  if(f->type == FD_PIPE)
+    r = pipepoll(f->pipe);
+  else if(f->type == FD_EVENTQ)
+    r = evqpoll(f->evq);
+  else if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV &&
+          devsw[f->major].poll)
+    r = devsw[f->major].poll();
+  else
+    r = POLLIN | POLLOUT;
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
+
+// Start a round of poll(): returns a sequence number for
+// pollwait(). Each pollbegin() needs a pollend().
+uint
+pollbegin(void)
+{
+  uint seq;
+
+  acquire(&pollq.lock);
+  pollq.nwait++;
+  seq = pollq.seq;
+  release(&pollq.lock);
+  return seq;
+}
+
+// Sleep, unless there has been a pollwakeup() since the
+// pollbegin() that returned seq. If timed, wake up by
+// the time ticks reaches deadline.
+void
+pollwait(uint seq, int timed, uint deadline)
+{
+  acquire(&pollq.lock);
+  if(pollq.seq == seq){
+    if(timed && (!pollq.timed || (int)(deadline - pollq.deadline) < 0)){
+      pollq.timed = 1;
+      pollq.deadline = deadline;
+    }
+    sleep(&pollq, &pollq.lock);
+  }
+  release(&pollq.lock);
+}
+
+void
+pollend(void)
+{
+  acquire(&pollq.lock);
+  pollq.nwait--;
+  release(&pollq.lock);
+}
+
+// Wake up processes in poll() to look again.
+// Cheap if there are none.
+void
+pollwakeup(void)
+{
+  // order the caller's change before the check of nwait,
+  // as pollbegin() orders nwait before looking at files.
+  __sync_synchronize();
+  if(pollq.nwait == 0)
+    return;
+  acquire(&pollq.lock);
+  pollq.seq++;
+  wakeup(&pollq);
+  release(&pollq.lock);
+}
+
+// Called every tick: wake processes in poll() if the earliest
+// timeout is due. They all look again, and those still waiting
+// set the next deadline as they go back to sleep.
+void
+polltick(void)
+{
+  __sync_synchronize();
+  if(pollq.timed == 0)
+    return;
+  acquire(&pollq.lock);
+  if(pollq.timed && (int)(ticks - pollq.deadline) >= 0){
+    pollq.timed = 0;
+    pollq.seq++;
+    wakeup(&pollq);
+  }
+  release(&pollq.lock);
+}
@@ -1,12 +1,14 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_EVENTQ } type;
   int ref; // reference count
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK: fail reads and writes that would block
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  struct evq *evq;   // FD_EVENTQ
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -27,12 +29,16 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+1];
+
+  struct inode *prev; // icache list, protected by icache.lock
+  struct inode *next;
 };
 
 // map major device number to device functions.
 struct devsw {
   int (*read)(int, uint64, int);
   int (*write)(int, uint64, int);
+  int (*poll)(void);  // POLLIN/POLLOUT, if reads or writes can block
 };
 
 extern struct devsw devsw[];
@@ -20,6 +20,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
@@ -44,6 +45,7 @@ fsinit(int dev) {
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
   initlog(dev, &sb);
+  swapinit(&sb);
 }
 
 // Zero a block.
@@ -163,7 +165,12 @@ bfree(int dev, uint b)
 // multi-step atomic operations.
 //
 // The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// entries. In-memory inodes come from a slab cache and stay
+// cached after iput() drops ip->ref to zero, so a later iget()
+// finds them without reading the disk. Once NINODE are cached,
+// iget() recycles the least recently released unreferenced one;
+// the page allocator can also take them back via ireclaim().
+// Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
 //
@@ -173,18 +180,23 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct kcache cache;
+  int n;                // number of cached inodes
+
+  // Doubly-linked list of all cached inodes, through prev/next.
+  struct inode head;
 } icache;
 
+static void ireclaim(void);
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
-  }
+  kcacheinit(&icache.cache, "inode", sizeof(struct inode));
+  icache.head.prev = &icache.head;
+  icache.head.next = &icache.head;
+  icache.cache.reclaim = ireclaim;
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -242,36 +254,92 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, *empty = 0, *spare = 0;
+  int nomem = 0;
 
+ again:
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = icache.head.next; ip != &icache.head; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&icache.lock);
+      if(empty)
+        kcachefree(&icache.cache, empty);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
+  // Allocate an entry, unless the cache is full or memory is
+  // short; then recycle the least recently released
+  // unreferenced one. kcachealloc() may call ireclaim(), so it
+  // must be called without icache.lock, and the cache may have
+  // filled up meanwhile.
+  if(empty == 0 || icache.n >= NINODE){
+    if(empty == 0 && icache.n < NINODE && !nomem){
+      release(&icache.lock);
+      if((empty = kcachealloc(&icache.cache)) == 0)
+        nomem = 1;
+      goto again;
+    }
+    for(ip = icache.head.prev; ip != &icache.head; ip = ip->prev)
+      if(ip->ref == 0)
+        break;
+    if(ip == &icache.head)
+      panic("iget: no inodes");
+    ip->next->prev = ip->prev;
+    ip->prev->next = ip->next;
+    icache.n--;
+    spare = empty;
+    empty = ip;
+  }
 
   ip = empty;
+  initsleeplock(&ip->lock, "inode");
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  ip->next = icache.head.next;
+  ip->prev = &icache.head;
+  icache.head.next->prev = ip;
+  icache.head.next = ip;
+  icache.n++;
   release(&icache.lock);
 
+  if(spare)
+    kcachefree(&icache.cache, spare);
   return ip;
 }
 
+// Free every cached inode that has no references.
+// Called via kcachereclaim() when memory runs out.
+static void
+ireclaim(void)
+{
+  struct inode *ip, *next, *unused = 0;
+
+  acquire(&icache.lock);
+  for(ip = icache.head.next; ip != &icache.head; ip = next){
+    next = ip->next;
+    if(ip->ref == 0){
+      ip->next->prev = ip->prev;
+      ip->prev->next = ip->next;
+      icache.n--;
+      ip->next = unused;
+      unused = ip;
+    }
+  }
+  release(&icache.lock);
+
+  while(unused){
+    ip = unused;
+    unused = ip->next;
+    kcachefree(&icache.cache, ip);
+  }
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
@@ -323,8 +391,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry
+// stays cached, unreferenced, for iget() to find or recycle.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -354,6 +422,22 @@ iput(struct inode *ip)
   }
 
   ip->ref--;
+  if(ip->ref == 0){
+    // move it to the front, so that iget() recycles the
+    // least recently released first; freed inodes go to
+    // the back, since nothing will look them up.
+    ip->next->prev = ip->prev;
+    ip->prev->next = ip->next;
+    if(ip->valid){
+      ip->next = icache.head.next;
+      ip->prev = &icache.head;
+    } else {
+      ip->next = &icache.head;
+      ip->prev = icache.head.prev;
+    }
+    ip->next->prev = ip;
+    ip->prev->next = ip;
+  }
   release(&icache.lock);
 }
 
@@ -1,6 +1,15 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers.
+//
+// A binary buddy allocator: free memory is kept in
+// blocks of 2^order contiguous, naturally aligned
+// 4096-byte pages, one free list per order. Allocation
+// splits a larger block if no block of the wanted order
+// is free; freeing merges a block with its "buddy" (the
+// other half of the block it was split from) whenever
+// the buddy is free too. kalloc() and kfree() are the
+// order-0 case.
 
 #include "types.h"
 #include "param.h"
@@ -9,6 +18,16 @@
 #include "riscv.h"
 #include "defs.h"
 
+// the largest block is PGSIZE << MAXORDER bytes.
+#define MAXORDER 10
+// a megapage is PGSIZE << MEGAORDER bytes.
+#define MEGAORDER 9
+// kzerofill() leaves at least this many pages free.
+#define ZEROMIN 256
+
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+#define PAGENO(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -16,17 +35,59 @@ extern char end[]; // first address after kernel.
 
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
   struct spinlock lock;
-  struct run *freelist;
+  struct run freelist[MAXORDER+1]; // circular list heads, one per order
+  // for each page: order+1 if the page starts a free
+  // block of that order, 0 otherwise.
+  uchar free[NPAGE];
+  // for each allocated page: references beyond the first,
+  // taken by kref() and dropped by kfree().
+  int ref[NPAGE];
+  uint64 nfree;  // free pages, in all orders
+  uint64 ntotal; // pages ever given to the allocator
 } kmem;
 
+// pages that idle harts have already zeroed,
+// for kalloc_zeroed().
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int n;
+} zpool;
+
+static int zreclaim(void);
+
+static void
+push(int order, struct run *r)
+{
+  struct run *h = &kmem.freelist[order];
+
+  r->next = h->next;
+  r->prev = h;
+  h->next->prev = r;
+  h->next = r;
+  kmem.free[PAGENO(r)] = order + 1;
+}
+
+static void
+unlink(struct run *r)
+{
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.free[PAGENO(r)] = 0;
+}
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  initlock(&zpool.lock, "zpool");
+  for(int i = 0; i <= MAXORDER; i++)
+    kmem.freelist[i].next = kmem.freelist[i].prev = &kmem.freelist[i];
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +96,126 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
     kfree(p);
+    kmem.ntotal++;
+  }
+}
+
+// Free the block of 2^order pages at pa, which normally
+// should have been returned by kallocpages(order).
+// (The exception is when initializing the allocator;
+// see kinit above.)
+void
+kfreepages(void *pa, int order)
+{
+  uint64 a = (uint64)pa;
+  uint64 buddy;
+  int norder = order;
+
+  if(order < 0 || order > MAXORDER || (a % (PGSIZE << order)) != 0 ||
+     (char*)pa < end || a + (PGSIZE << order) > PHYSTOP)
+    panic("kfree");
+
+  acquire(&kmem.lock);
+  if(kmem.free[PAGENO(a)])
+    panic("kfree: freeing free block");
+  for(; order < MAXORDER; order++){
+    buddy = a ^ (PGSIZE << order);
+    if(buddy + (PGSIZE << order) > PHYSTOP || kmem.free[PAGENO(buddy)] != order + 1)
+      break;
+    // the buddy is free and whole: merge.
+    unlink((struct run*)buddy);
+    if(buddy < a)
+      a = buddy;
+  }
+  push(order, (struct run*)a);
+  kmem.nfree += 1L << norder;
+  release(&kmem.lock);
+}
+
+// Take 2^order pages from the free lists, if that leaves
+// at least min pages free. Never reclaims anything.
+static void *
+takepages(int order, uint64 min)
+{
+  struct run *r;
+  int k;
+
+  acquire(&kmem.lock);
+  for(k = order; k <= MAXORDER; k++)
+    if(kmem.freelist[k].next != &kmem.freelist[k])
+      break;
+  if(k > MAXORDER || kmem.nfree < min + (1L << order)){
+    release(&kmem.lock);
+    return 0;
+  }
+  r = kmem.freelist[k].next;
+  unlink(r);
+  kmem.nfree -= 1L << order;
+  // split, returning the upper halves to the free lists.
+  while(k > order){
+    k--;
+    push(k, (struct run*)((char*)r + (PGSIZE << k)));
+  }
+  release(&kmem.lock);
+
+  return (void*)r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned
+// to their size. Returns a pointer that the kernel can use.
+// Returns 0 if the memory cannot be allocated.
+void *
+kallocpages(int order)
+{
+  void *r;
+
+  if(order < 0 || order > MAXORDER)
+    return 0;
+
+  while((r = takepages(order, 0)) == 0){
+    // try to get pages back from the slab caches
+    // and the pre-zeroed pool.
+    if(kcachereclaim() > 0 || zreclaim() > 0)
+      continue;
+    // failing that, push a user page out to swap, if we are
+    // in a process and hold no spinlocks, so may sleep.
+    if(order == 0 && intr_get() && myproc() != 0 && swapout() > 0)
+      continue;
+    return 0;
+  }
+  return r;
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// call to kalloc(). If kref() has added references
+// to the page, drop one instead.
 void
 kfree(void *pa)
 {
-  struct run *r;
-
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  if(__sync_fetch_and_sub(&kmem.ref[PAGENO(pa)], 1) > 0)
+    return;
+  kmem.ref[PAGENO(pa)] = 0;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
-  r = (struct run*)pa;
+  kfreepages(pa, 0);
+}
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+// Add a reference to an allocated page, so that it takes
+// one more kfree() to free it.
+void
+kref(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kref");
+  __sync_fetch_and_add(&kmem.ref[PAGENO(pa)], 1);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -68,15 +224,110 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
-  struct run *r;
-
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  void *r = kallocpages(0);
 
   if(r)
     memset((char*)r, 5, PGSIZE); // fill with junk
+  return r;
+}
+
+// Allocate one zero-filled 4096-byte page, preferably one
+// that an idle hart has already cleared (see kzerofill()).
+// Returns 0 if the memory cannot be allocated.
+void *
+kalloc_zeroed(void)
+{
+  struct run *r;
+
+  acquire(&zpool.lock);
+  r = zpool.list;
+  if(r){
+    zpool.list = r->next;
+    zpool.n--;
+  }
+  release(&zpool.lock);
+
+  if(r){
+    r->next = 0; // the only non-zero word.
+    return (void*)r;
+  }
+  if((r = kallocpages(0)) != 0)
+    memset((char*)r, 0, PGSIZE);
   return (void*)r;
 }
+
+// Called by scheduler() when this hart has nothing to run:
+// zero one free page and add it to the pool used by
+// kalloc_zeroed(). Returns 1 if it did some work,
+// 0 if the pool is full or fewer than ZEROMIN pages are free.
+int
+kzerofill(void)
+{
+  struct run *r;
+
+  if(zpool.n >= NZEROPAGE)  // racy but harmless peek.
+    return 0;
+  // don't reclaim or swap for this; it would only undo itself.
+  if((r = takepages(0, ZEROMIN)) == 0)
+    return 0;
+  memset((char*)r, 0, PGSIZE);
+
+  acquire(&zpool.lock);
+  if(zpool.n >= NZEROPAGE){
+    release(&zpool.lock);
+    kfreepages(r, 0);
+    return 0;
+  }
+  r->next = zpool.list;
+  zpool.list = r;
+  zpool.n++;
+  release(&zpool.lock);
+  return 1;
+}
+
+// Give the pre-zeroed pages back to the buddy allocator.
+// Returns the number of pages returned.
+static int
+zreclaim(void)
+{
+  struct run *r;
+  int n;
+
+  acquire(&zpool.lock);
+  r = zpool.list;
+  n = zpool.n;
+  zpool.list = 0;
+  zpool.n = 0;
+  release(&zpool.lock);
+
+  while(r){
+    struct run *next = r->next;
+    kfreepages(r, 0);
+    r = next;
+  }
+  return n;
+}
+
+// Report free and total memory, in bytes, in O(1).
+// Pages in the pre-zeroed pool count as free.
+void
+kmemstat(uint64 *freemem, uint64 *totalmem)
+{
+  *freemem = (kmem.nfree + zpool.n) * PGSIZE;
+  *totalmem = kmem.ntotal * PGSIZE;
+}
+
+// Allocate one 2-megabyte aligned megapage.
+// Unlike kalloc(), the contents are not junk-filled.
+void *
+kallocmega(void)
+{
+  return kallocpages(MEGAORDER);
+}
+
+// Free a megapage returned by kallocmega().
+void
+kfreemega(void *pa)
+{
+  kfreepages(pa, MEGAORDER);
+}
@@ -27,6 +27,9 @@ main()
     binit();         // buffer cache
     iinit();         // inode cache
     fileinit();      // file table
+    pipeinit();      // pipe allocator
+    shminit();       // shared memory segments
+    evinit();        // event queues
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
     __sync_synchronize();
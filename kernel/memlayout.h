@@ -27,8 +27,11 @@
 
 // local interrupt controller, which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid))
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define CLINT_HZ 10000000L           // MTIME's rate in qemu.
+#define CLINT_NS (1000000000L / CLINT_HZ) // nanoseconds per cycle.
 
 // qemu puts programmable interrupt controller here.
 #define PLIC 0x0c000000L
@@ -62,6 +65,39 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   URING (the process's submission ring, if any)
+//   SHMBASE (shared memory segments, up to USERTOP)
+//   ...
+//   UCLOCK (the clock, read-only, shared by all processes)
+//   USYSCALL (the process's own read-only data)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// pages that user code reads instead of making system calls.
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define UCLOCK (USYSCALL - PGSIZE)
+
+struct usyscall {
+  int pid;
+};
+
+struct uclock {
+  uint ticks;    // as returned by uptime()
+  uint64 time;   // the CLINT's time at the latest tick
+};
+
+// each process's kernel page table also maps its user memory
+// at the same addresses, so user memory must stay below the
+// lowest device the kernel maps.
+#define USERTOP PLIC
+
+// shared memory segment i is mapped at SHMADDR(i) in every
+// process that maps it.
+#define SHMMAX (2*1024*1024)  // bytes per segment
+#define SHMBASE (USERTOP - NSHM*SHMMAX)
+#define SHMADDR(i) (SHMBASE + (uint64)(i)*SHMMAX)
+
+// the page shared with the kernel by uringsetup(); the heap
+// must stay below it.
+#define URING (SHMBASE - PGSIZE)
@@ -7,18 +7,47 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+// the buffer is 2^PIPEORDER contiguous pages from the buddy
+// allocator, so reads and writes copy in big chunks.
+#define PIPEORDER 2
+#define PIPESIZE (PGSIZE << PIPEORDER)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *data;     // PIPESIZE bytes
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int rbusy;      // a splice is reading from data in place
+  int wbusy;      // a splice is writing into data in place
+  struct evwatch *watch; // event queues watching either end
 };
 
+struct kcache pipecache;
+
+static int pipestate(struct pipe*);
+
+// pi's state has changed: tell poll() and event queues.
+// pi->lock must be held.
+static void
+pipechanged(struct pipe *pi)
+{
+  pollwakeup();
+  evnotify(&pi->watch, pipestate(pi));
+}
+
+void
+pipeinit(void)
+{
+  kcacheinit(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,12 +57,17 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == 0)
+  if((pi = (struct pipe*)kcachealloc(&pipecache)) == 0)
+    goto bad;
+  if((pi->data = kallocpages(PIPEORDER)) == 0)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
   pi->nread = 0;
+  pi->rbusy = 0;
+  pi->wbusy = 0;
+  pi->watch = 0;
   initlock(&pi->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -46,8 +80,11 @@ pipealloc(struct file **f0, struct file **f1)
   return 0;
 
  bad:
-  if(pi)
-    kfree((char*)pi);
+  if(pi){
+    if(pi->data)
+      kfreepages(pi->data, PIPEORDER);
+    kcachefree(&pipecache, pi);
+  }
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -66,62 +103,193 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pipechanged(pi);
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kfreepages(pi->data, PIPEORDER);
+    kcachefree(&pipecache, pi);
   } else
     release(&pi->lock);
 }
 
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
-  int i;
-  char ch;
+  int i, m;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(pi->readopen == 0 || pr->killed){
+  for(i = 0; i < n; i += m){
+    while(pi->nwrite == pi->nread + PIPESIZE || pi->wbusy){  //DOC: pipewrite-full
+      if((pi->readopen == 0 && !pi->wbusy) || pr->killed){
         release(&pi->lock);
         return -1;
       }
       wakeup(&pi->nread);
+      pipechanged(pi);
+      if(nonblock){
+        if(i == 0)
+          i = -1;
+        goto out;
+      }
       sleep(&pi->nwrite, &pi->lock);
     }
-    if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
+    // as much as there is room for, up to the end of the buffer.
+    m = min(n - i, PIPESIZE - (pi->nwrite - pi->nread));
+    m = min(m, PIPESIZE - pi->nwrite % PIPESIZE);
+    if(copyin(pr->pagetable, &pi->data[pi->nwrite % PIPESIZE], addr + i, m) == -1)
       break;
-    pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    pi->nwrite += m;
   }
+ out:
   wakeup(&pi->nread);
+  pipechanged(pi);
   release(&pi->lock);
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, uint64 addr, int n, int nonblock)
 {
-  int i;
+  int i, m;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(pr->killed){
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rbusy){  //DOC: pipe-empty
+    if(pr->killed || nonblock){
       release(&pi->lock);
       return -1;
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
-      break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    m = min(n - i, pi->nwrite - pi->nread);
+    m = min(m, PIPESIZE - pi->nread % PIPESIZE);
+    if(copyout(pr->pagetable, addr + i, &pi->data[pi->nread % PIPESIZE], m) == -1)
       break;
+    pi->nread += m;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pipechanged(pi);
   release(&pi->lock);
   return i;
 }
+
+// Which of POLLIN, POLLOUT and POLLHUP apply to pi now.
+// pi->lock must be held.
+static int
+pipestate(struct pipe *pi)
+{
+  int r = 0;
+
+  if(pi->nread != pi->nwrite || !pi->writeopen)
+    r |= POLLIN;
+  if(pi->nwrite != pi->nread + PIPESIZE || !pi->readopen)
+    r |= POLLOUT;
+  if(!pi->readopen || !pi->writeopen)
+    r |= POLLHUP;
+  return r;
+}
+
+int
+pipepoll(struct pipe *pi)
+{
+  int r;
+
+  acquire(&pi->lock);
+  r = pipestate(pi);
+  release(&pi->lock);
+  return r;
+}
+
+struct evwatch**
+pipewatches(struct pipe *pi)
+{
+  return &pi->watch;
+}
+
+// Splicing (see filesplice()) moves data between a pipe and a
+// file without a buffer in between, by letting the file system
+// read into or write from the pipe's buffer directly. Since
+// that can sleep, the pipe lock can't be held meanwhile; the
+// busy flags keep other readers or writers out instead.
+
+// Reserve room for up to n bytes at the write end, and set *buf
+// to where they go. Returns the number of bytes reserved, or -1
+// if no one will ever read them. pipewend() must follow.
+int
+pipewbegin(struct pipe *pi, char **buf, int n)
+{
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while(pi->nwrite == pi->nread + PIPESIZE || pi->wbusy){
+    if((pi->readopen == 0 && !pi->wbusy) || pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    wakeup(&pi->nread);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  if(pi->readopen == 0){
+    release(&pi->lock);
+    return -1;
+  }
+  n = min(n, PIPESIZE - (pi->nwrite - pi->nread));
+  n = min(n, PIPESIZE - pi->nwrite % PIPESIZE);
+  *buf = &pi->data[pi->nwrite % PIPESIZE];
+  pi->wbusy = 1;
+  release(&pi->lock);
+  return n;
+}
+
+// Finish a pipewbegin(), having written n bytes.
+void
+pipewend(struct pipe *pi, int n)
+{
+  acquire(&pi->lock);
+  pi->nwrite += n;
+  pi->wbusy = 0;
+  wakeup(&pi->nread);
+  wakeup(&pi->nwrite);
+  pipechanged(pi);
+  release(&pi->lock);
+}
+
+// Wait for data at the read end, and set *buf to up to n bytes
+// of it. Returns the number of bytes, 0 at end of file, or -1
+// if killed. piperend() must follow a positive return.
+int
+piperbegin(struct pipe *pi, char **buf, int n)
+{
+  struct proc *pr = myproc();
+
+  acquire(&pi->lock);
+  while((pi->nread == pi->nwrite && pi->writeopen) || pi->rbusy){
+    if(pr->killed){
+      release(&pi->lock);
+      return -1;
+    }
+    sleep(&pi->nread, &pi->lock);
+  }
+  n = min(n, pi->nwrite - pi->nread);
+  n = min(n, PIPESIZE - pi->nread % PIPESIZE);
+  *buf = &pi->data[pi->nread % PIPESIZE];
+  if(n > 0)
+    pi->rbusy = 1;
+  release(&pi->lock);
+  return n;
+}
+
+// Finish a piperbegin(), having consumed n bytes.
+void
+piperend(struct pipe *pi, int n)
+{
+  acquire(&pi->lock);
+  pi->nread += n;
+  pi->rbusy = 0;
+  wakeup(&pi->nwrite);
+  wakeup(&pi->nread);
+  pipechanged(pi);
+  release(&pi->lock);
+}
@@ -0,0 +1,16 @@
+// poll() events
+#define POLLIN    0x001  // read won't block: data or end of file
+#define POLLOUT   0x004  // write won't block
+#define POLLHUP   0x010  // the other end of a pipe is closed
+#define POLLNVAL  0x020  // fd is not open
+
+// evctl() operations
+#define EV_ADD    1
+#define EV_MOD    2
+#define EV_DEL    3
+
+struct pollfd {
+  int fd;         // ignored if negative
+  short events;   // POLLIN and/or POLLOUT
+  short revents;  // set by poll()
+};
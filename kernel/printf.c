@@ -15,18 +15,103 @@
 #include "defs.h"
 #include "proc.h"
 
-volatile int panicked = 0;
+volatile int panicked = 0; // the CPU that panicked, plus one
+
+// Kernel messages go into a log ring, and from there into the
+// UART's transmit buffer, which the UART interrupt empties; so
+// printf() never waits for the UART. Writers need no lock: they
+// reserve space with an atomic add, copy their text in, and
+// publish it in the order they reserved. The ring keeps the
+// latest KLOGSIZE bytes for dmesg(). Only panic() writes to the
+// UART directly.
+#define KLOGSIZE 16384
 
-// lock to avoid interleaving concurrent printf's.
 static struct {
-  struct spinlock lock;
-  int locking;
-} pr;
+  struct spinlock lock;  // protects drained
+  char buf[KLOGSIZE];
+  uint64 reserved;       // bytes claimed by writers
+  uint64 written;        // bytes complete and published
+  uint64 drained;        // bytes given to the UART
+} klog;
+
+// formatted text collects here, and goes to the log a
+// bufferful at a time, or straight to the UART in a panic.
+struct pbuf {
+  int n;
+  char buf[128];
+};
+
+static int panicking;
 
 static char digits[] = "0123456789abcdef";
 
+// Move published text from the log into the UART's transmit
+// buffer, as much as fits. Called after printing, and by the
+// UART interrupt as the transmit buffer empties.
+void
+klogdrain(void)
+{
+  uint64 off, n;
+  int m;
+
+  acquire(&klog.lock);
+  while(klog.drained < klog.written){
+    if(klog.written - klog.drained > KLOGSIZE)
+      klog.drained = klog.written - KLOGSIZE; // overwritten before it went out
+    off = klog.drained % KLOGSIZE;
+    n = klog.written - klog.drained;
+    if(n > KLOGSIZE - off)
+      n = KLOGSIZE - off;
+    if((m = uartputs(&klog.buf[off], n)) == 0)
+      break;
+    klog.drained += m;
+  }
+  release(&klog.lock);
+}
+
+static void
+klogwrite(char *s, int n)
+{
+  uint64 start;
+  int i;
+
+  // no interrupt handler on this hart may print until we have
+  // published, or it would wait for us forever.
+  push_off();
+  start = __sync_fetch_and_add(&klog.reserved, n);
+  for(i = 0; i < n; i++)
+    klog.buf[(start + i) % KLOGSIZE] = s[i];
+  // wait for writers that reserved earlier to publish.
+  while(__atomic_load_n(&klog.written, __ATOMIC_ACQUIRE) != start)
+    ;
+  __atomic_store_n(&klog.written, start + n, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+static void
+flush(struct pbuf *pb)
+{
+  int i;
+
+  if(panicking){
+    for(i = 0; i < pb->n; i++)
+      consputc(pb->buf[i]);
+  } else {
+    klogwrite(pb->buf, pb->n);
+  }
+  pb->n = 0;
+}
+
+static void
+putc(struct pbuf *pb, int c)
+{
+  if(pb->n == sizeof(pb->buf))
+    flush(pb);
+  pb->buf[pb->n++] = c;
+}
+
 static void
-printint(int xx, int base, int sign)
+printint(struct pbuf *pb, int xx, int base, int sign)
 {
   char buf[16];
   int i;
@@ -46,17 +131,17 @@ printint(int xx, int base, int sign)
     buf[i++] = '-';
 
   while(--i >= 0)
-    consputc(buf[i]);
+    putc(pb, buf[i]);
 }
 
 static void
-printptr(uint64 x)
+printptr(struct pbuf *pb, uint64 x)
 {
   int i;
-  consputc('0');
-  consputc('x');
+  putc(pb, '0');
+  putc(pb, 'x');
   for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4)
-    consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+    putc(pb, digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
 // Print to the console. only understands %d, %x, %p, %s.
@@ -64,20 +149,18 @@ void
 printf(char *fmt, ...)
 {
   va_list ap;
-  int i, c, locking;
+  int i, c;
   char *s;
-
-  locking = pr.locking;
-  if(locking)
-    acquire(&pr.lock);
+  struct pbuf pb;
 
   if (fmt == 0)
     panic("null fmt");
 
+  pb.n = 0;
   va_start(ap, fmt);
   for(i = 0; (c = fmt[i] & 0xff) != 0; i++){
     if(c != '%'){
-      consputc(c);
+      putc(&pb, c);
       continue;
     }
     c = fmt[++i] & 0xff;
@@ -85,50 +168,92 @@ printf(char *fmt, ...)
       break;
     switch(c){
     case 'd':
-      printint(va_arg(ap, int), 10, 1);
+      printint(&pb, va_arg(ap, int), 10, 1);
       break;
     case 'x':
-      printint(va_arg(ap, int), 16, 1);
+      printint(&pb, va_arg(ap, int), 16, 1);
       break;
     case 'p':
-      printptr(va_arg(ap, uint64));
+      printptr(&pb, va_arg(ap, uint64));
       break;
     case 's':
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
       for(; *s; s++)
-        consputc(*s);
+        putc(&pb, *s);
       break;
     case '%':
-      consputc('%');
+      putc(&pb, '%');
       break;
     default:
       // Print unknown % sequence to draw attention.
-      consputc('%');
-      consputc(c);
+      putc(&pb, '%');
+      putc(&pb, c);
       break;
     }
   }
-
-  if(locking)
-    release(&pr.lock);
+  flush(&pb);
+  if(!panicking)
+    klogdrain();
 }
 
 void
 panic(char *s)
 {
-  pr.locking = 0;
+  uint64 i, end;
+
+  // the UART interrupt may never come, so print synchronously.
+  // setting panicked first stops the other CPUs' UART output,
+  // the interrupt-driven transmitter included; then send what
+  // it had queued but not sent, and what the log hadn't yet
+  // given it.
+  intr_off();
+  if(__sync_val_compare_and_swap(&panicked, 0, cpuid() + 1) != 0)
+    for(;;)
+      ; // another CPU is already panicking
+  panicking = 1;
+  uartflush();
+  if(!holding(&klog.lock))
+    acquire(&klog.lock);
+  end = __atomic_load_n(&klog.written, __ATOMIC_ACQUIRE);
+  if(end - klog.drained > KLOGSIZE)
+    klog.drained = end - KLOGSIZE;
+  for(i = klog.drained; i < end; i++)
+    consputc(klog.buf[i % KLOGSIZE]);
+  klog.drained = end;
   printf("panic: ");
   printf(s);
   printf("\n");
-  panicked = 1; // freeze uart output from other CPUs
   for(;;)
     ;
 }
 
+// Copy the latest n bytes (at most) of the log to user address
+// dst. Returns the number of bytes copied.
+int
+klogread(uint64 dst, int n)
+{
+  char buf[128];
+  uint64 end, i;
+  int m;
+
+  end = __atomic_load_n(&klog.written, __ATOMIC_ACQUIRE);
+  if(n > KLOGSIZE)
+    n = KLOGSIZE;
+  if(n > end)
+    n = end;
+  for(i = end - n; i < end; i += m){
+    m = end - i < sizeof(buf) ? end - i : sizeof(buf);
+    for(int j = 0; j < m; j++)
+      buf[j] = klog.buf[(i + j) % KLOGSIZE];
+    if(copyout(myproc()->pagetable, dst + (i - (end - n)), buf, m) < 0)
+      return -1;
+  }
+  return n;
+}
+
 void
 printfinit(void)
 {
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
+  initlock(&klog.lock, "klog");
 }
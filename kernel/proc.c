@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "sysinfo.h"
 
 struct cpu cpus[NCPU];
 
@@ -12,12 +13,29 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
+extern pagetable_t kernel_pagetable; // vm.c
+
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// bumped by every wakeup(), for idle harts to notice.
+volatile uint wakeups;
+
+// how long processes wait to run once runnable: schedlat[i]
+// counts waits of [2^(i-1), 2^i) microseconds, the last
+// bucket all longer ones.
+uint64 schedlat[NSCHEDLAT];
+
+// a process woken while every hart it may use is busy makes
+// one of them yield, if it has run this long (CLINT cycles).
+#define MINSLICE (CLINT_HZ / 1000)
+
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static void kickidle(struct proc *p);
+static void runnable(struct proc *p);
+static void schedstat(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,7 +44,13 @@ void
 procinit(void)
 {
   struct proc *p;
+  int useasid;
   
+  // give each process slot an ASID if satp has enough bits, so
+  // that switching page tables needn't flush the whole TLB.
+  // otherwise everyone shares ASID 0 and every switch flushes.
+  useasid = (1L << asidbits()) > NPROC;
+
   initlock(&pid_lock, "nextpid");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
@@ -40,6 +64,7 @@ procinit(void)
       uint64 va = KSTACK((int) (p - proc));
       kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
       p->kstack = va;
+      p->asid = useasid ? (p - proc) + 1 : 0;
   }
   kvminithart();
 }
@@ -106,6 +131,9 @@ allocproc(void)
 
 found:
   p->pid = allocpid();
+  p->state = USED;
+  p->affinity = -1;
+  p->lastcpu = -1;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
@@ -113,6 +141,14 @@ found:
     return 0;
   }
 
+  // And the page that tells user code its pid.
+  if((p->usyscall = (struct usyscall *)kalloc_zeroed()) == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  p->usyscall->pid = p->pid;
+
   // An empty user page table.
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
@@ -121,6 +157,14 @@ found:
     return 0;
   }
 
+  // The kernel page table to use while running this process.
+  p->kpagetable = kvmcreate();
+  if(p->kpagetable == 0){
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+
   // Set up new context to start executing at forkret,
   // which returns to user space.
   memset(&p->context, 0, sizeof(p->context));
@@ -139,10 +183,23 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
+  if(p->usyscall)
+    kfree((void*)p->usyscall);
+  p->usyscall = 0;
+  if(p->pagetable){
+    shmunmapall(p, p->pagetable);
+    uringfree(p, p->pagetable);
     proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
+  if(p->kpagetable)
+    kvmfree(p->kpagetable);
+  p->kpagetable = 0;
   p->sz = 0;
+  p->rss = 0;
+  p->guard = 0;
+  p->nsyscall = 0;
+  p->nmigrate = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -182,6 +239,24 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // and the pages user code may read in place of getpid()
+  // and uptime().
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(p->usyscall), PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+  if(mappages(pagetable, UCLOCK, PGSIZE,
+              (uint64)uclock, PTE_R | PTE_U) < 0){
+    uvmunmap(pagetable, USYSCALL, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -192,6 +267,8 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, USYSCALL, 1, 0);
+  uvmunmap(pagetable, UCLOCK, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -220,6 +297,8 @@ userinit(void)
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
+  p->rss = 1;
+  kvmsyncuser(p);
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -228,7 +307,7 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  runnable(p);
 
   release(&p->lock);
 }
@@ -243,12 +322,15 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz + n > URING || (sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
       return -1;
     }
+    p->rss += (PGROUNDUP(sz) - PGROUNDUP(p->sz)) / PGSIZE;
   } else if(n < 0){
+    p->rss -= uvmresident(p->pagetable, PGROUNDUP(sz + n), PGROUNDUP(sz));
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
+  kvmsyncuser(p);
   p->sz = sz;
   return 0;
 }
@@ -267,13 +349,27 @@ fork(void)
     return -1;
   }
 
-  // Copy user memory from parent to child.
+  // Copy user memory from parent to child. uvmcopy() may
+  // sleep to swap pages out or in, so it can't hold np->lock;
+  // np is USED, so no one else will touch it meanwhile.
+  release(&np->lock);
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
   np->sz = p->sz;
+  np->guard = p->guard;
+  if(shmfork(p, np) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  acquire(&np->lock);
+  kvmsyncuser(np);
+  np->rss = PGROUNDUP(p->sz) / PGSIZE;  // uvmcopy() made every page resident
 
   np->parent = p;
 
@@ -290,16 +386,60 @@ fork(void)
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
+  np->affinity = p->affinity;
 
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  runnable(np);
+  kickidle(np);
 
   release(&np->lock);
 
   return pid;
 }
 
+// Create a child running the program at path with argv,
+// without copying our memory as fork() then exec() would.
+// ofile is the child's file table; its references pass to
+// the child if spawn() succeeds. Returns the child's pid.
+int
+spawn(char *path, char **argv, struct file **ofile)
+{
+  int i, argc, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0){
+    return -1;
+  }
+
+  // exec() sleeps, so it can't hold np->lock; np is USED,
+  // so no one else will touch it meanwhile.
+  release(&np->lock);
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if((argc = execproc(np, path, argv)) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->trapframe->a0 = argc;
+
+  for(i = 0; i < NOFILE; i++)
+    np->ofile[i] = ofile[i];
+  np->cwd = idup(p->cwd);
+
+  acquire(&np->lock);
+  np->parent = p;
+  np->affinity = p->affinity;
+  pid = np->pid;
+  runnable(np);
+  kickidle(np);
+  release(&np->lock);
+
+  return pid;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -446,6 +586,20 @@ wait(uint64 addr)
   }
 }
 
+// May a hart other than the one p last ran on run it? Only if
+// p may no longer run there, or that hart is busy with another
+// process or idle, rather than about to look for work.
+// Caller must hold p->lock.
+static int
+stealable(struct proc *p)
+{
+  struct cpu *c = &cpus[p->lastcpu];
+
+  if((p->affinity & (1L << p->lastcpu)) == 0)
+    return 1;
+  return c->proc != 0 || c->idle;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -458,34 +612,92 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int id = cpuid();
+  int pass, found, skipped;
+  uint gen;
   
   c->proc = 0;
+  c->online = 1;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
     
-    int found = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
+    found = skipped = 0;
+    gen = wakeups;
+    // first run processes that last ran here, whose state
+    // may still be in this hart's caches and TLB; then any
+    // others this hart may run, unless the hart they last ran
+    // on is about to pick them up itself.
+    for(pass = 0; pass < 2 && !found; pass++){
+      for(p = proc; p < &proc[NPROC]; p++) {
+        acquire(&p->lock);
+        if(p->state != RUNNABLE || (p->affinity & (1L << id)) == 0 ||
+           (pass == 0 && p->lastcpu != id && p->lastcpu >= 0)){
+          release(&p->lock);
+          continue;
+        }
+        if(pass == 1 && p->lastcpu >= 0 && !stealable(p)){
+          skipped = 1;
+          release(&p->lock);
+          continue;
+        }
         // Switch to chosen process.  It is the process's job
         // to release its lock and then reacquire it
         // before jumping back to us.
         p->state = RUNNING;
+        schedstat(p);
+        if(p->lastcpu != id && p->lastcpu >= 0)
+          p->nmigrate++;
+        p->lastcpu = id;
         c->proc = p;
+        c->runstart = r_time();
+        c->resched = 0;
+        w_satp(MAKE_SATP(p->kpagetable) | SATP_ASID(p->asid));
+        if(p->asid == 0){
+          sfence_vma();
+        } else if(c->asidgen[p->asid] != p->asidgen){
+          // its page tables changed since it last ran here.
+          sfence_vma_asid(p->asid);
+          c->asidgen[p->asid] = p->asidgen;
+        }
         swtch(&c->context, &p->context);
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
+        // Leave its kernel page table before anyone can free it;
+        // its TLB entries can stay if they are under its own ASID.
+        if(p->asid == 0)
+          kvminithart();
+        else
+          w_satp(MAKE_SATP(kernel_pagetable));
         c->proc = 0;
 
         found = 1;
+        release(&p->lock);
       }
-      release(&p->lock);
     }
-    if(found == 0) {
+    if(found == 0 && skipped == 0) {
       intr_on();
-      asm volatile("wfi");
+      // nothing to run: do some page zeroing for
+      // kalloc_zeroed(), and sleep only if there's none,
+      // without clock ticks to wake us for nothing.
+      // wakeup() sends an IPI to an idle hart; if one came
+      // before we said we were idle, look again instead.
+      // interrupts stay off until after wfi, so an IPI sent
+      // once we're idle stays pending and ends the wfi,
+      // rather than being taken just before it.
+      if(kzerofill() == 0){
+        intr_off();
+        c->idle = 1;
+        __sync_synchronize();
+        if(wakeups == gen){
+          clockidle(1);
+          asm volatile("wfi");
+          clockidle(0);
+        }
+        c->idle = 0;
+        intr_on();
+      }
     }
   }
 }
@@ -501,6 +713,7 @@ void
 sched(void)
 {
   int intena;
+  uint64 sum;
   struct proc *p = myproc();
 
   if(!holding(&p->lock))
@@ -512,9 +725,16 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  // SUM is per-hart; a preempted copyout() may have set it, and
+  // it must neither leak to whatever runs next nor be lost.
+  sum = r_sstatus() & SSTATUS_SUM;
+  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
+
+  w_sstatus(r_sstatus() | sum);
 }
 
 // Give up the CPU for one scheduling round.
@@ -523,11 +743,32 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  mycpu()->resched = 0;
+  runnable(p);
   sched();
   release(&p->lock);
 }
 
+// p can run now. Caller must hold p->lock.
+static void
+runnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->readytime = r_time();
+}
+
+// p is about to run, having waited since p->readytime.
+static void
+schedstat(struct proc *p)
+{
+  uint64 us = (r_time() - p->readytime) * CLINT_NS / 1000;
+  int i;
+
+  for(i = 0; i < NSCHEDLAT - 1 && us > 0; i++)
+    us >>= 1;
+  __sync_fetch_and_add(&schedlat[i], 1);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -583,6 +824,57 @@ sleep(void *chan, struct spinlock *lk)
   }
 }
 
+// Ask hart h to yield, if it may run p and its process has
+// had MINSLICE. Returns 1 if asked.
+static int
+preempt(struct proc *p, int h, int me)
+{
+  struct cpu *c = &cpus[h];
+
+  if((p->affinity & (1L << h)) == 0 || c->proc == 0 ||
+     r_time() - c->runstart < MINSLICE)
+    return 0;
+  c->resched = 1;
+  if(h != me)
+    sendipi(h);
+  return 1;
+}
+
+// Harts idle in scheduler() only look for work when they get
+// an interrupt: send one an IPI for p, which just became
+// runnable, preferring the hart p last ran on. If none is
+// idle, preempt a busy one, so p needn't wait for a tick.
+// Caller must hold p->lock.
+static void
+kickidle(struct proc *p)
+{
+  struct cpu *c;
+  int me, h;
+
+  __sync_fetch_and_add(&wakeups, 1);
+  push_off();
+  me = cpuid();
+  if(p->lastcpu >= 0 && p->lastcpu != me && (p->affinity & (1L << p->lastcpu)) &&
+     __sync_bool_compare_and_swap(&cpus[p->lastcpu].idle, 1, 0)){
+    sendipi(p->lastcpu);
+    goto out;
+  }
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c - cpus != me && (p->affinity & (1L << (c - cpus))) &&
+       __sync_bool_compare_and_swap(&c->idle, 1, 0)){
+      sendipi(c - cpus);
+      goto out;
+    }
+  }
+  if(p->lastcpu >= 0 && preempt(p, p->lastcpu, me))
+    goto out;
+  for(h = 0; h < NCPU; h++)
+    if(preempt(p, h, me))
+      break;
+ out:
+  pop_off();
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void
@@ -593,7 +885,8 @@ wakeup(void *chan)
   for(p = proc; p < &proc[NPROC]; p++) {
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
+      runnable(p);
+      kickidle(p);
     }
     release(&p->lock);
   }
@@ -607,8 +900,36 @@ wakeup1(struct proc *p)
   if(!holding(&p->lock))
     panic("wakeup1");
   if(p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
+    runnable(p);
+    kickidle(p);
+  }
+}
+
+// Restrict the current process to the harts in mask, moving
+// it if it's on one no longer in it. Returns 0, or -1 if mask
+// has no hart that is running.
+int
+setaffinity(uint64 mask)
+{
+  struct proc *p = myproc();
+  uint64 online = 0;
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    if(cpus[i].online)
+      online |= 1L << i;
+  if((mask & online) == 0)
+    return -1;
+
+  acquire(&p->lock);
+  p->affinity = mask;
+  if((mask & (1L << cpuid())) == 0){
+    runnable(p);
+    kickidle(p);
+    sched();
   }
+  release(&p->lock);
+  return 0;
 }
 
 // Kill the process with the given pid.
@@ -625,7 +946,8 @@ kill(int pid)
       p->killed = 1;
       if(p->state == SLEEPING){
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        runnable(p);
+        kickidle(p);
       }
       release(&p->lock);
       return 0;
@@ -673,6 +995,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
@@ -693,3 +1016,47 @@ procdump(void)
     printf("\n");
   }
 }
+
+// Copy a struct procinfo for each process in use to the user
+// array at addr, which has room for max entries.
+// Returns the number of entries copied, or -1.
+int
+procinfo(uint64 addr, int max)
+{
+  struct proc *p;
+  struct procinfo pi;
+  int n = 0;
+
+  for(p = proc; p < &proc[NPROC] && n < max; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    pi.pid = p->pid;
+    pi.state = p->state;
+    pi.sz = p->sz;
+    pi.rss = p->rss * PGSIZE;
+    pi.nsyscall = p->nsyscall;
+    pi.nmigrate = p->nmigrate;
+    safestrcpy(pi.name, p->name, sizeof(pi.name));
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, addr + n*sizeof(pi), (char*)&pi, sizeof(pi)) < 0)
+      return -1;
+    n++;
+  }
+  return n;
+}
+
+// Count the processes in use.
+int
+nproc(void)
+{
+  struct proc *p;
+  int n = 0;
+
+  for(p = proc; p < &proc[NPROC]; p++)
+    if(p->state != UNUSED)  // racy, but only a statistic.
+      n++;
+  return n;
+}
@@ -24,6 +24,11 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen[NPROC+1];    // p->asidgen as of the last flush of each ASID here
+  int idle;                   // waiting in scheduler() for wakeup() to kick it
+  int online;                 // has entered scheduler()
+  int resched;                // the process here should yield when it can
+  uint64 runstart;            // time (CLINT) the process here started running
 };
 
 extern struct cpu cpus[NCPU];
@@ -34,7 +39,9 @@ extern struct cpu cpus[NCPU];
 // the sscratch register points here.
 // uservec in trampoline.S saves user registers in the trapframe,
 // then initializes registers from the trapframe's
-// kernel_sp, kernel_hartid, kernel_satp, and jumps to kernel_trap.
+// kernel_sp, kernel_hartid, kernel_satp, and jumps to kernel_trap,
+// or for a system call to kernel_syscall, having left out the
+// temporaries t0-t6.
 // usertrapret() and userret in trampoline.S set up
 // the trapframe's kernel_*, restore user registers from the
 // trapframe, switch to the user page table, and enter user space.
@@ -78,9 +85,10 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 kernel_syscall; // usersyscall()
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -93,12 +101,26 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int swapok;                  // Preempted in user space; pages may be swapped out
+  uint64 affinity;             // Harts it may run on, a bit each
+  int lastcpu;                 // Hart it last ran on, or -1
+  uint64 nmigrate;             // Times it ran on a different hart from last time
+  uint64 readytime;            // Time (CLINT) it last became RUNNABLE
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
+  uint64 rss;                  // Resident user pages
+  uint64 guard;                // Stack guard page (no PTE_U), or 0
+  uint64 nsyscall;             // System calls made
   pagetable_t pagetable;       // User page table
+  pagetable_t kpagetable;      // Kernel page table, with user memory too
+  int asid;                    // Address-space ID for both page tables, or 0
+  uint64 asidgen;              // Bumped when the page tables change
+  uint shmmask;                // Shared memory segments mapped, a bit each
+  struct uring *uring;         // Submission ring page mapped at URING, or 0
   struct trapframe *trapframe; // data page for trampoline.S
+  struct usyscall *usyscall;   // mapped read-only at USYSCALL
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
@@ -0,0 +1,216 @@
+//
+// Shared memory segments, named by integer keys.
+//
+// shmmap(key, size) maps segment key into the calling process,
+// creating it with size bytes of zeroed memory if no segment
+// has that key. Segment i always appears at SHMADDR(i), so a
+// pointer into it means the same thing in every process.
+//
+// The pages are reference counted with kref(): the segment
+// holds one reference to each, and every mapping another, which
+// uvmunmap() drops. The segment goes away, and with it its own
+// references, when the last process mapping it unmaps it, execs
+// or exits. fork() gives the child the parent's mappings.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct shmseg {
+  int key;
+  int npages;      // 0 if the slot is free
+  int nmap;        // processes that map it
+  uint64 *pages;   // physical addresses, in a page of their own
+};
+
+struct {
+  struct spinlock lock;
+  struct shmseg seg[NSHM];
+} shm;
+
+void
+shminit(void)
+{
+  initlock(&shm.lock, "shm");
+}
+
+static void
+freepages(uint64 *pages, int n)
+{
+  for(int i = 0; i < n; i++)
+    kfree((void*)pages[i]);
+  kfree(pages);
+}
+
+// Map segment i into pagetable. Caller must hold shm.lock.
+// Returns 0 on success, -1 if out of memory.
+static int
+mapseg(pagetable_t pagetable, int i)
+{
+  struct shmseg *s = &shm.seg[i];
+  int n;
+
+  for(n = 0; n < s->npages; n++){
+    if(mappages(pagetable, SHMADDR(i) + n*PGSIZE, PGSIZE, s->pages[n],
+                PTE_R|PTE_W|PTE_U) < 0){
+      uvmunmap(pagetable, SHMADDR(i), n, 1);
+      return -1;
+    }
+    kref((void*)s->pages[n]);
+  }
+  s->nmap++;
+  return 0;
+}
+
+// Unmap segment i from pagetable, and free the segment if
+// no one else maps it. Caller must hold shm.lock.
+static void
+unmapseg(pagetable_t pagetable, int i)
+{
+  struct shmseg *s = &shm.seg[i];
+
+  uvmunmap(pagetable, SHMADDR(i), s->npages, 1);
+  if(--s->nmap == 0){
+    freepages(s->pages, s->npages);
+    s->pages = 0;
+    s->npages = 0;
+  }
+}
+
+static struct shmseg*
+lookup(int key)
+{
+  for(struct shmseg *s = shm.seg; s < &shm.seg[NSHM]; s++)
+    if(s->npages && s->key == key)
+      return s;
+  return 0;
+}
+
+// Map the segment with key into the current process, creating
+// it with size bytes if it doesn't exist (size 0 only maps an
+// existing segment). Returns its user address, or -1.
+uint64
+shmmap(int key, int size)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  uint64 *pages = 0;
+  int i, n = 0;
+
+  if(size < 0 || size > SHMMAX)
+    return -1;
+
+  acquire(&shm.lock);
+  if((s = lookup(key)) == 0 && size > 0){
+    // allocate outside the lock, since kalloc() may swap.
+    release(&shm.lock);
+    if((pages = kalloc()) == 0)
+      return -1;
+    for(n = 0; n < PGROUNDUP(size)/PGSIZE; n++){
+      if((pages[n] = (uint64)kalloc_zeroed()) == 0){
+        freepages(pages, n);
+        return -1;
+      }
+    }
+    acquire(&shm.lock);
+    // someone may have created it meanwhile.
+    if((s = lookup(key)) == 0){
+      for(s = shm.seg; s < &shm.seg[NSHM] && s->npages; s++)
+        ;
+      if(s == &shm.seg[NSHM])
+        goto bad;
+      s->key = key;
+      s->npages = n;
+      s->nmap = 0;
+      s->pages = pages;
+      pages = 0;
+    }
+  }
+  if(s == 0 || size > s->npages*PGSIZE)
+    goto bad;
+  i = s - shm.seg;
+  if((p->shmmask & (1 << i)) == 0){
+    if(mapseg(p->pagetable, i) < 0){
+      if(s->nmap == 0){
+        freepages(s->pages, s->npages);
+        s->npages = 0;
+      }
+      goto bad;
+    }
+    p->shmmask |= 1 << i;
+  }
+  release(&shm.lock);
+  if(pages)
+    freepages(pages, n);
+  kvmsyncuser(p);
+  return SHMADDR(i);
+
+ bad:
+  release(&shm.lock);
+  if(pages)
+    freepages(pages, n);
+  return -1;
+}
+
+// Unmap the segment with key from the current process.
+int
+shmunmap(int key)
+{
+  struct proc *p = myproc();
+  struct shmseg *s;
+  int i;
+
+  acquire(&shm.lock);
+  if((s = lookup(key)) == 0 || (p->shmmask & (1 << (i = s - shm.seg))) == 0){
+    release(&shm.lock);
+    return -1;
+  }
+  unmapseg(p->pagetable, i);
+  p->shmmask &= ~(1 << i);
+  release(&shm.lock);
+  kvmsyncuser(p);
+  return 0;
+}
+
+// Give fork()'s child np the segments that p maps.
+int
+shmfork(struct proc *p, struct proc *np)
+{
+  int i;
+
+  acquire(&shm.lock);
+  for(i = 0; i < NSHM; i++){
+    if((p->shmmask & (1 << i)) == 0)
+      continue;
+    if(mapseg(np->pagetable, i) < 0){
+      release(&shm.lock);
+      shmunmapall(np, np->pagetable);
+      return -1;
+    }
+    np->shmmask |= 1 << i;
+  }
+  release(&shm.lock);
+  return 0;
+}
+
+// Unmap all of p's segments from pagetable, which is p's
+// page table or, in exec(), the one it is giving up.
+void
+shmunmapall(struct proc *p, pagetable_t pagetable)
+{
+  int i;
+
+  if(p->shmmask == 0)
+    return;
+  acquire(&shm.lock);
+  for(i = 0; i < NSHM; i++)
+    if(p->shmmask & (1 << i))
+      unmapseg(pagetable, i);
+  p->shmmask = 0;
+  release(&shm.lock);
+}
@@ -0,0 +1,236 @@
+// Slab allocator, for small fixed-size kernel objects
+// such as pipes, open files, and in-memory inodes.
+//
+// A kcache hands out objects of a single size. Objects are
+// carved out of whole pages ("slabs") from kalloc(); each
+// slab starts with a struct slab header followed by as many
+// objects as fit. A slab whose objects are all free goes back
+// to kalloc(). Each CPU keeps a short stack of freed objects,
+// so most allocations and frees don't touch the shared slabs.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;      // kcache partial list
+  struct slab *prev;
+  struct kcache *cache;
+  void *freelist;         // free objects in this slab
+  uint nfree;
+};
+
+// objects start here in each slab page.
+#define SLABHDR ((sizeof(struct slab) + 15) & ~15)
+
+// all caches, for kcachereclaim().
+// only added to at boot, on one CPU.
+static struct kcache *kcaches;
+
+void
+kcacheinit(struct kcache *c, char *name, uint size)
+{
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 15) & ~15;
+  c->perslab = (PGSIZE - SLABHDR) / c->size;
+  if(c->perslab == 0)
+    panic("kcacheinit: object too big");
+  c->partial = 0;
+  c->reclaim = 0;
+  for(int i = 0; i < NCPU; i++){
+    initlock(&c->cpu[i].lock, name);
+    c->cpu[i].n = 0;
+  }
+  c->next = kcaches;
+  kcaches = c;
+}
+
+// put s on c's partial list. caller holds c->lock.
+static void
+pushslab(struct kcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// take s off c's partial list. caller holds c->lock.
+static void
+unlinkslab(struct kcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+// take an object from a partial slab, or return 0.
+// caller holds c->lock.
+static void*
+slaballoc(struct kcache *c)
+{
+  struct slab *s = c->partial;
+  void *o;
+
+  if(s == 0)
+    return 0;
+  o = s->freelist;
+  s->freelist = *(void**)o;
+  if(--s->nfree == 0)
+    unlinkslab(c, s);
+  return o;
+}
+
+// return o to its slab. if that leaves the slab
+// entirely free, unlink it and return it, so that
+// the caller can kfree() it after releasing c->lock.
+// caller holds c->lock.
+static struct slab*
+slabfree(struct kcache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+
+  if(s->cache != c)
+    panic("kcachefree");
+  *(void**)o = s->freelist;
+  s->freelist = o;
+  if(s->nfree++ == 0)
+    pushslab(c, s);
+  if(s->nfree == c->perslab){
+    unlinkslab(c, s);
+    return s;
+  }
+  return 0;
+}
+
+// Allocate one object from c.
+// Returns 0 if the memory cannot be allocated.
+// The object's contents are undefined.
+void*
+kcachealloc(struct kcache *c)
+{
+  void *o = 0;
+  struct slab *s;
+  char *p;
+
+  // this CPU's recently freed objects.
+  push_off();
+  acquire(&c->cpu[cpuid()].lock);
+  if(c->cpu[cpuid()].n > 0)
+    o = c->cpu[cpuid()].obj[--c->cpu[cpuid()].n];
+  release(&c->cpu[cpuid()].lock);
+  pop_off();
+  if(o)
+    return o;
+
+  acquire(&c->lock);
+  o = slaballoc(c);
+  release(&c->lock);
+  if(o)
+    return o;
+
+  // no free objects anywhere: make a new slab.
+  // kalloc() may call kcachereclaim(), so hold no locks.
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->freelist = 0;
+  s->nfree = c->perslab;
+  for(p = (char*)s + SLABHDR + (c->perslab-1)*c->size; p >= (char*)s + SLABHDR; p -= c->size){
+    *(void**)p = s->freelist;
+    s->freelist = p;
+  }
+  acquire(&c->lock);
+  pushslab(c, s);
+  o = slaballoc(c);
+  release(&c->lock);
+  return o;
+}
+
+// Free an object allocated from c.
+void
+kcachefree(struct kcache *c, void *o)
+{
+  struct slab *s, *empty = 0;
+  int i;
+
+  push_off();
+  acquire(&c->cpu[cpuid()].lock);
+  if(c->cpu[cpuid()].n < NKCPU){
+    c->cpu[cpuid()].obj[c->cpu[cpuid()].n++] = o;
+    o = 0;
+  } else {
+    // this CPU's stack is full; return half of it
+    // (and o) to the slabs.
+    acquire(&c->lock);
+    for(i = 0; i < NKCPU/2; i++){
+      if((s = slabfree(c, c->cpu[cpuid()].obj[--c->cpu[cpuid()].n])) != 0){
+        s->next = empty;
+        empty = s;
+      }
+    }
+    if((s = slabfree(c, o)) != 0){
+      s->next = empty;
+      empty = s;
+    }
+    release(&c->lock);
+  }
+  release(&c->cpu[cpuid()].lock);
+  pop_off();
+
+  while(empty){
+    s = empty;
+    empty = s->next;
+    kfree(s);
+  }
+}
+
+// Ask each cache's owner to free the objects it keeps but
+// doesn't need, return every CPU's cached objects to their
+// slabs, and free the slabs that become empty. Called by the
+// page allocator when it runs out of memory.
+// Returns the number of pages freed.
+int
+kcachereclaim(void)
+{
+  struct kcache *c;
+  struct slab *s, *empty = 0;
+  int n = 0;
+
+  for(c = kcaches; c; c = c->next)
+    if(c->reclaim)
+      c->reclaim();
+
+  for(c = kcaches; c; c = c->next){
+    for(int i = 0; i < NCPU; i++){
+      acquire(&c->cpu[i].lock);
+      acquire(&c->lock);
+      while(c->cpu[i].n > 0){
+        if((s = slabfree(c, c->cpu[i].obj[--c->cpu[i].n])) != 0){
+          s->next = empty;
+          empty = s;
+        }
+      }
+      release(&c->lock);
+      release(&c->cpu[i].lock);
+    }
+  }
+
+  while(empty){
+    s = empty;
+    empty = s->next;
+    kfree(s);
+    n++;
+  }
+  return n;
+}
@@ -0,0 +1,20 @@
+// Slab allocator cache for fixed-size kernel objects.
+
+#define NKCPU 8  // free objects kept per CPU
+
+struct kcache {
+  struct spinlock lock;   // protects partial and the slabs on it
+  char *name;             // Name of cache (debugging)
+  uint size;              // object size, rounded up
+  uint perslab;           // objects per slab page
+  struct slab *partial;   // slabs with at least one free object
+  struct kcache *next;    // all caches, for kcachereclaim()
+  void (*reclaim)(void);  // frees unused objects, for kcachereclaim(), or 0
+
+  // recently freed objects, per CPU.
+  struct {
+    struct spinlock lock; // only contended by kcachereclaim()
+    int n;
+    void *obj[NKCPU];
+  } cpu[NCPU];
+};
@@ -0,0 +1,16 @@
+// File-descriptor actions for the spawn() system call.
+// They are applied in order to a copy of the caller's
+// descriptors, which the new process then starts with.
+
+#define SPAWN_CLOSE 1  // close fd
+#define SPAWN_DUP2  2  // make fd a copy of descriptor arg
+#define SPAWN_OPEN  3  // open path with mode arg as fd
+
+#define NSPAWNFD 16    // maximum actions per spawn()
+
+struct spawnfd {
+  int op;
+  int fd;
+  int arg;
+  char *path;
+};
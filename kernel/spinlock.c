@@ -105,6 +105,12 @@ pop_off(void)
   if(c->noff < 1)
     panic("pop_off");
   c->noff -= 1;
-  if(c->noff == 0 && c->intena)
+  if(c->noff == 0 && c->intena){
+    // the last spinlock is gone, and interrupts were on: the
+    // kernel can be preempted here as well as by an interrupt,
+    // if a tick or another hart has asked it to be.
+    if(c->resched && c->proc && c->proc->state == RUNNING)
+      yield();
     intr_on();
+  }
 }
@@ -33,8 +33,10 @@ start()
   // disable paging for now.
   w_satp(0);
 
-  // delegate all interrupts and exceptions to supervisor mode.
-  w_medeleg(0xffff);
+  // delegate all interrupts and exceptions to supervisor mode,
+  // except ecalls from supervisor mode, which ask timervec
+  // for a timer interrupt.
+  w_medeleg(0xffff & ~(1 << 9));
   w_mideleg(0xffff);
   w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
@@ -66,18 +68,36 @@ timerinit()
   // prepare information in scratch[] for timervec.
   // scratch[0..3] : space for timervec to save registers.
   // scratch[4] : address of CLINT MTIMECMP register.
-  // scratch[5] : desired interval (in cycles) between timer interrupts.
+  // scratch[5] : desired interval (in cycles) between clock ticks.
+  // scratch[6] : time of the next clock tick.
+  // scratch[7] : time of the alarm setalarm() asked for; none yet.
+  // scratch[8] : address of CLINT MTIME register.
+  // scratch[9] : nonzero while the hart is idle; not yet.
+  // scratch[10] : address of the CLINT MSIP registers.
+  // scratch[11] : set by timervec when it delivers a tick.
+  // scratch[12] : set by timervec when it delivers an alarm.
   uint64 *scratch = &mscratch0[32 * id];
   scratch[4] = CLINT_MTIMECMP(id);
   scratch[5] = interval;
+  scratch[6] = *(uint64*)CLINT_MTIMECMP(id);
+  scratch[7] = -1;
+  scratch[8] = CLINT_MTIME;
+  scratch[9] = 0;
+  scratch[10] = CLINT_MSIP(0);
+  scratch[11] = 0;
+  scratch[12] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
   w_mtvec((uint64)timervec);
 
+  // let supervisor mode read the CLINT's time with rdtime.
+  w_mcounteren(r_mcounteren() | 2);
+
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer interrupts, and software
+  // interrupts, which other harts send with sendipi().
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
@@ -0,0 +1,220 @@
+//
+// Swapping user pages to the disk region after the file system.
+//
+// When kalloc() finds no free page it calls swapout(), which
+// runs a clock over user pages: each pass clears the accessed
+// bit (PTE_A) that the hardware sets, and the first page found
+// with it still clear is written to a free swap slot and freed.
+// Its PTE loses PTE_V, gains PTE_S, and holds the slot number
+// where the physical page number was. A page fault on such a
+// PTE, or a copyin()/copyout() that reaches it, calls swapin().
+//
+// Pages are only taken from the calling process and from
+// processes preempted in user space (p->swapok), since then
+// nothing in the kernel is in the middle of using them.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "defs.h"
+
+#define SLOT_USED 1  // holds a page
+#define SLOT_BUSY 2  // being written to disk
+#define SLOT_DEAD 4  // freed while busy
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;
+  uint start;          // first block of the swap area
+  uint nslot;          // number of slots
+  uint next;           // where to look for a free slot
+  uchar state[NSWAP];  // SLOT_ flags
+  int hand;            // clock hand: a process
+  uint64 handva;       // and a user address in it
+} swap;
+
+void
+swapinit(struct superblock *sb)
+{
+  initlock(&swap.lock, "swap");
+  swap.start = sb->swapstart;
+  swap.nslot = sb->nswap;
+  if(swap.nslot > NSWAP)
+    swap.nslot = NSWAP;
+}
+
+// Allocate a slot, marked busy. Returns -1 if swap is full.
+static int
+slotalloc(void)
+{
+  int i, s;
+
+  acquire(&swap.lock);
+  for(i = 0; i < swap.nslot; i++){
+    s = (swap.next + i) % swap.nslot;
+    if(swap.state[s] == 0){
+      swap.state[s] = SLOT_USED | SLOT_BUSY;
+      swap.next = s + 1;
+      release(&swap.lock);
+      return s;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Free a slot whose page is no longer needed.
+// If it is still being written, swapout() frees it when done.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(swap.state[slot] & SLOT_BUSY)
+    swap.state[slot] |= SLOT_DEAD;
+  else
+    swap.state[slot] = 0;
+  release(&swap.lock);
+}
+
+// Read the page in slot into the page at pa.
+void
+swapread(void *pa, uint slot)
+{
+  acquire(&swap.lock);
+  while(swap.state[slot] & SLOT_BUSY)
+    sleep(&swap.state[slot], &swap.lock);
+  release(&swap.lock);
+  virtio_disk_rwpage(pa, swap.start + slot*SWAPBLKS, 0);
+}
+
+// Move the clock hand on to the next process.
+static void
+advance(struct proc *p)
+{
+  acquire(&swap.lock);
+  if(swap.hand == p - proc){
+    swap.hand = (swap.hand + 1) % NPROC;
+    swap.handva = 0;
+  }
+  release(&swap.lock);
+}
+
+// Write one user page out to swap and free it. Called by
+// kalloc() when memory is exhausted; may sleep, so the caller
+// must hold no spinlocks. Returns 1 if a page was freed, 0 if
+// there was no page to take or no swap slot to put it in.
+int
+swapout(void)
+{
+  struct proc *p;
+  pte_t *pte;
+  uint64 va, pa;
+  int i, slot;
+
+  // take the slot first: swap.lock must not be acquired while
+  // holding a p->lock, since wakeup() and sleep() on swap.lock
+  // acquire them the other way round.
+  if((slot = slotalloc()) < 0)
+    return 0;
+
+  // two full turns of the clock: the first may only clear
+  // accessed bits.
+  for(i = 0; i <= 2*NPROC; i++){
+    acquire(&swap.lock);
+    p = &proc[swap.hand];
+    va = swap.handva;
+    release(&swap.lock);
+
+    acquire(&p->lock);
+    if(p->pagetable == 0 || !((p->state == RUNNABLE && p->swapok) || p == myproc())){
+      release(&p->lock);
+      advance(p);
+      continue;
+    }
+    if((va = uvmclock(p->pagetable, va, p->sz)) >= p->sz){
+      release(&p->lock);
+      advance(p);
+      continue;
+    }
+    pte = walk(p->pagetable, va, 0);
+    pa = PTE2PA(*pte);
+    *pte = SLOT2PTE(slot) | (PTE_FLAGS(*pte) & ~(PTE_V|PTE_A|PTE_D)) | PTE_S;
+    p->rss--;
+    p->asidgen++;  // flush p's ASID wherever it runs next
+    release(&p->lock);
+    sfence_vma();  // if p is us, our kernel page table maps the page too
+
+    acquire(&swap.lock);
+    swap.handva = va + PGSIZE;
+    release(&swap.lock);
+
+    // the page is unreachable now: p isn't in user space, and its
+    // TLB entries go when it is next switched to.
+    virtio_disk_rwpage((void*)pa, swap.start + slot*SWAPBLKS, 1);
+    kfree((void*)pa);
+
+    acquire(&swap.lock);
+    if(swap.state[slot] & SLOT_DEAD)
+      swap.state[slot] = 0;
+    else
+      swap.state[slot] &= ~SLOT_BUSY;
+    release(&swap.lock);
+    wakeup(&swap.state[slot]);
+    return 1;
+  }
+
+  // nothing to take; nobody else has seen the slot.
+  acquire(&swap.lock);
+  swap.state[slot] = 0;
+  release(&swap.lock);
+  return 0;
+}
+
+// Bring p's page at va back from swap. p must be the current
+// process, and the caller must hold no spinlocks. Returns 0 on
+// success, -1 if the page isn't swapped out or no memory.
+int
+swapin(struct proc *p, uint64 va)
+{
+  pte_t *pte;
+  char *mem;
+  uint slot;
+
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz || (pte = walk(p->pagetable, va, 0)) == 0 ||
+     (*pte & PTE_S) == 0)
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  slot = PTE2SLOT(*pte);
+  swapread(mem, slot);
+
+  acquire(&p->lock);
+  // mark it accessed, so the clock doesn't pick it right away.
+  *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~PTE_S) | PTE_V | PTE_A;
+  p->rss++;
+  p->asidgen++;
+  release(&p->lock);
+  sfence_vma();
+  swapfree(slot);
+  return 0;
+}
+
+// Bring in any swapped-out pages of [va, va+n) in the current
+// process, ahead of a copy that will be made with a spinlock
+// held (pipes, the console, wait()) and so can't sleep.
+void
+swapinrange(uint64 va, uint64 n)
+{
+  struct proc *p = myproc();
+  uint64 a;
+
+  for(a = PGROUNDDOWN(va); a < va + n && a < p->sz; a += PGSIZE)
+    swapin(p, a);
+}
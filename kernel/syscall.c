@@ -104,6 +104,22 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_sysinfo(void);
+extern uint64 sys_procinfo(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_shmmap(void);
+extern uint64 sys_shmunmap(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_poll(void);
+extern uint64 sys_evqueue(void);
+extern uint64 sys_evctl(void);
+extern uint64 sys_evwait(void);
+extern uint64 sys_uringsetup(void);
+extern uint64 sys_uringenter(void);
+extern uint64 sys_dmesg(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_setaffinity(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,6 +143,22 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_sysinfo] sys_sysinfo,
+[SYS_procinfo] sys_procinfo,
+[SYS_spawn]   sys_spawn,
+[SYS_shmmap]  sys_shmmap,
+[SYS_shmunmap] sys_shmunmap,
+[SYS_splice]  sys_splice,
+[SYS_fcntl]   sys_fcntl,
+[SYS_poll]    sys_poll,
+[SYS_evqueue] sys_evqueue,
+[SYS_evctl]   sys_evctl,
+[SYS_evwait]  sys_evwait,
+[SYS_uringsetup] sys_uringsetup,
+[SYS_uringenter] sys_uringenter,
+[SYS_dmesg]   sys_dmesg,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_setaffinity] sys_setaffinity,
 };
 
 void
@@ -136,6 +168,7 @@ syscall(void)
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
+  p->nsyscall++;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     p->trapframe->a0 = syscalls[num]();
   } else {
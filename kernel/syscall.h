@@ -20,3 +20,19 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_sysinfo 22
+#define SYS_procinfo 23
+#define SYS_spawn  24
+#define SYS_shmmap 25
+#define SYS_shmunmap 26
+#define SYS_splice 27
+#define SYS_fcntl  28
+#define SYS_poll   29
+#define SYS_evqueue 30
+#define SYS_evctl  31
+#define SYS_evwait 32
+#define SYS_uringsetup 33
+#define SYS_uringenter 34
+#define SYS_dmesg  35
+#define SYS_nanosleep 36
+#define SYS_setaffinity 37
@@ -15,6 +15,8 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
+#include "poll.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -78,6 +80,146 @@ sys_read(void)
   return fileread(f, p, n);
 }
 
+// get or set a file's O_ flags; only O_NONBLOCK can be set.
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  if(cmd == F_GETFL)
+    return (f->readable && f->writable ? O_RDWR : f->writable ? O_WRONLY : O_RDONLY) |
+           (f->nonblock ? O_NONBLOCK : 0);
+  if(cmd == F_SETFL){
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+// wait until one of a set of file descriptors is ready for
+// reading or writing, or for timeout ticks (forever if
+// negative). returns the number of ready descriptors.
+uint64
+sys_poll(void)
+{
+  struct pollfd fds[NOFILE];
+  struct proc *p = myproc();
+  struct file *f;
+  uint64 addr;
+  int nfds, timeout, i, n;
+  uint seq, start;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &nfds) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(nfds < 0 || nfds > NOFILE ||
+     copyin(p->pagetable, (char*)fds, addr, nfds*sizeof(fds[0])) < 0)
+    return -1;
+
+  start = ticks;
+  for(;;){
+    seq = pollbegin();
+    n = 0;
+    for(i = 0; i < nfds; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if(fds[i].fd >= NOFILE || (f = p->ofile[fds[i].fd]) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+        fds[i].revents = filepoll(f) & (fds[i].events | POLLHUP);
+      if(fds[i].revents)
+        n++;
+    }
+    if(n > 0 || timeout == 0 || (timeout > 0 && ticks - start >= timeout) ||
+       p->killed){
+      pollend();
+      break;
+    }
+    pollwait(seq, timeout > 0, start + timeout);
+    pollend();
+  }
+
+  if(p->killed ||
+     copyout(p->pagetable, addr, (char*)fds, nfds*sizeof(fds[0])) < 0)
+    return -1;
+  return n;
+}
+
+// create an event queue.
+uint64
+sys_evqueue(void)
+{
+  struct file *f;
+  int fd;
+
+  if((f = filealloc()) == 0)
+    return -1;
+  if((f->evq = evqalloc()) == 0){
+    fileclose(f);
+    return -1;
+  }
+  f->type = FD_EVENTQ;
+  f->readable = 1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+// add, change or remove an event queue's watch on fd.
+uint64
+sys_evctl(void)
+{
+  struct file *q, *f;
+  int op, fd, events;
+
+  if(argfd(0, 0, &q) < 0 || argint(1, &op) < 0 || argfd(2, &fd, &f) < 0 ||
+     argint(3, &events) < 0)
+    return -1;
+  if(q->type != FD_EVENTQ)
+    return -1;
+  return evctl(q->evq, op, f, fd, events);
+}
+
+// wait for events on a queue.
+uint64
+sys_evwait(void)
+{
+  struct pollfd evs[NOFILE];
+  struct file *q;
+  uint64 addr;
+  int max, timeout, n;
+
+  if(argfd(0, 0, &q) < 0 || argaddr(1, &addr) < 0 || argint(2, &max) < 0 ||
+     argint(3, &timeout) < 0)
+    return -1;
+  if(q->type != FD_EVENTQ || max <= 0)
+    return -1;
+  if(max > NOFILE)
+    max = NOFILE;
+  if((n = evwait(q->evq, evs, max, timeout)) > 0 &&
+     copyout(myproc()->pagetable, addr, (char*)evs, n*sizeof(evs[0])) < 0)
+    return -1;
+  return n;
+}
+
+// move data from one file to another without copying it
+// through user space.
+uint64
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
 uint64
 sys_write(void)
 {
@@ -283,17 +425,12 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-uint64
-sys_open(void)
+// Open path with omode, returning a new struct file.
+static struct file*
+openfile(char *path, int omode)
 {
-  char path[MAXPATH];
-  int fd, omode;
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0)
-    return -1;
 
   begin_op();
 
@@ -301,33 +438,31 @@ sys_open(void)
     ip = create(path, T_FILE, 0, 0);
     if(ip == 0){
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if((ip = namei(path)) == 0){
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if(ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
-    if(f)
-      fileclose(f);
+  if((f = filealloc()) == 0){
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if(ip->type == T_DEVICE){
@@ -340,6 +475,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -348,6 +484,24 @@ sys_open(void)
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+uint64
+sys_open(void)
+{
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+
+  if(argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0)
+    return -1;
+  if((f = openfile(path, omode)) == 0)
+    return -1;
+  if((fd = fdalloc(f)) < 0){
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -412,46 +566,133 @@ sys_chdir(void)
   return 0;
 }
 
-uint64
-sys_exec(void)
+// Fetch the user argv array at uargv into argv[MAXARG],
+// one kalloc()ed page per string. The caller must
+// freeargv() even if this fails.
+static int
+fetchargv(uint64 uargv, char **argv)
 {
-  char path[MAXPATH], *argv[MAXARG];
   int i;
-  uint64 uargv, uarg;
+  uint64 uarg;
 
-  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG*sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv)){
-      goto bad;
+    if(i >= MAXARG){
+      return -1;
     }
     if(fetchaddr(uargv+sizeof(uint64)*i, (uint64*)&uarg) < 0){
-      goto bad;
+      return -1;
     }
     if(uarg == 0){
       argv[i] = 0;
-      break;
+      return 0;
     }
     argv[i] = kalloc();
     if(argv[i] == 0)
-      goto bad;
+      return -1;
     if(fetchstr(uarg, argv[i], PGSIZE) < 0)
-      goto bad;
+      return -1;
   }
+}
 
-  int ret = exec(path, argv);
+static void
+freeargv(char **argv)
+{
+  int i;
 
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
+  for(i = 0; i < MAXARG && argv[i] != 0; i++)
     kfree(argv[i]);
+}
 
+uint64
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  uint64 uargv;
+  int ret;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0){
+    return -1;
+  }
+  ret = -1;
+  if(fetchargv(uargv, argv) == 0)
+    ret = exec(path, argv);
+  freeargv(argv);
   return ret;
+}
 
- bad:
-  for(i = 0; i < NELEM(argv) && argv[i] != 0; i++)
-    kfree(argv[i]);
-  return -1;
+// Apply a spawn() file action to ofile, a file table
+// being prepared for a new process.
+static int
+spawnfd(struct file **ofile, struct spawnfd *a)
+{
+  char path[MAXPATH];
+  struct file *f;
+
+  if(a->fd < 0 || a->fd >= NOFILE)
+    return -1;
+  switch(a->op){
+  case SPAWN_CLOSE:
+    f = 0;
+    break;
+  case SPAWN_DUP2:
+    if(a->arg < 0 || a->arg >= NOFILE || (f = ofile[a->arg]) == 0)
+      return -1;
+    if(a->arg == a->fd)
+      return 0;
+    filedup(f);
+    break;
+  case SPAWN_OPEN:
+    if(fetchstr((uint64)a->path, path, MAXPATH) < 0 ||
+       (f = openfile(path, a->arg)) == 0)
+      return -1;
+    break;
+  default:
+    return -1;
+  }
+  if(ofile[a->fd])
+    fileclose(ofile[a->fd]);
+  ofile[a->fd] = f;
+  return 0;
+}
+
+// spawn(path, argv, actions, nactions): start a new child
+// running path, without copying our memory as fork() would.
+uint64
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnfd acts[NSPAWNFD];
+  struct file *ofile[NOFILE];
+  struct proc *p = myproc();
+  uint64 uargv, uacts;
+  int i, nacts, pid;
+
+  if(argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 ||
+     argaddr(2, &uacts) < 0 || argint(3, &nacts) < 0)
+    return -1;
+  if(nacts < 0 || nacts > NSPAWNFD ||
+     copyin(p->pagetable, (char*)acts, uacts, nacts*sizeof(acts[0])) < 0)
+    return -1;
+
+  for(i = 0; i < NOFILE; i++)
+    if((ofile[i] = p->ofile[i]) != 0)
+      filedup(ofile[i]);
+  pid = -1;
+  for(i = 0; i < nacts; i++)
+    if(spawnfd(ofile, &acts[i]) < 0)
+      goto out;
+  if(fetchargv(uargv, argv) == 0)
+    pid = spawn(path, argv, ofile);
+  freeargv(argv);
+
+ out:
+  // spawn() took the file references if it worked.
+  if(pid < 0)
+    for(i = 0; i < NOFILE; i++)
+      if(ofile[i])
+        fileclose(ofile[i]);
+  return pid;
 }
 
 uint64
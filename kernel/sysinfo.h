@@ -0,0 +1,22 @@
+// Memory and process statistics, returned by the
+// sysinfo() and procinfo() system calls.
+
+#define NSCHEDLAT 16
+
+struct sysinfo {
+  uint64 freemem;   // free physical memory (bytes)
+  uint64 totalmem;  // memory managed by the page allocator (bytes)
+  uint64 nproc;     // number of processes in use
+  uint64 schedlat[NSCHEDLAT];  // waits to run, in power-of-two
+                               // microsecond buckets (see proc.c)
+};
+
+struct procinfo {
+  int pid;
+  int state;        // enum procstate in proc.h
+  uint64 sz;        // size of process memory (bytes)
+  uint64 rss;       // resident user memory (bytes)
+  uint64 nsyscall;  // system calls made
+  uint64 nmigrate;  // times it moved to another hart
+  char name[16];
+};
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sysinfo.h"
 
 uint64
 sys_exit(void)
@@ -35,6 +36,8 @@ sys_wait(void)
   uint64 p;
   if(argaddr(0, &p) < 0)
     return -1;
+  if(p != 0)
+    swapinrange(p, sizeof(int));  // wait() copies out holding locks
   return wait(p);
 }
 
@@ -95,3 +98,109 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// sleep for at least n nanoseconds, woken by a timer interrupt
+// at that time rather than at the next clock tick.
+uint64
+sys_nanosleep(void)
+{
+  uint64 n, deadline;
+
+  if(argaddr(0, &n) < 0)
+    return -1;
+  n = n / CLINT_NS + (n % CLINT_NS != 0);
+  if((deadline = r_time() + n) < n)
+    deadline = -1;
+  return nanosleep(deadline);
+}
+
+// report system-wide memory and process counts.
+uint64
+sys_sysinfo(void)
+{
+  uint64 addr;
+  struct sysinfo info;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  kmemstat(&info.freemem, &info.totalmem);
+  info.nproc = nproc();
+  memmove(info.schedlat, schedlat, sizeof(info.schedlat));
+  if(copyout(myproc()->pagetable, addr, (char*)&info, sizeof(info)) < 0)
+    return -1;
+  return 0;
+}
+
+// fill a user array of struct procinfo, one per process.
+uint64
+sys_procinfo(void)
+{
+  uint64 addr;
+  int max;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &max) < 0)
+    return -1;
+  return procinfo(addr, max);
+}
+
+// run only on the harts in a mask, a bit each.
+uint64
+sys_setaffinity(void)
+{
+  uint64 mask;
+
+  if(argaddr(0, &mask) < 0)
+    return -1;
+  return setaffinity(mask);
+}
+
+// map a shared memory segment, creating it if need be.
+uint64
+sys_shmmap(void)
+{
+  int key, size;
+
+  if(argint(0, &key) < 0 || argint(1, &size) < 0)
+    return -1;
+  return shmmap(key, size);
+}
+
+// copy the latest kernel messages to a user buffer.
+uint64
+sys_dmesg(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return klogread(addr, n);
+}
+
+// map the calling process's submission and completion rings.
+uint64
+sys_uringsetup(void)
+{
+  return uringsetup();
+}
+
+// carry out up to n operations queued in the ring.
+uint64
+sys_uringenter(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return uringenter(n);
+}
+
+uint64
+sys_shmunmap(void)
+{
+  int key;
+
+  if(argint(0, &key) < 0)
+    return -1;
+  return shmunmap(key);
+}
@@ -8,8 +8,17 @@
 
 struct spinlock tickslock;
 uint ticks;
+struct uclock *uclock;  // mapped read-only at UCLOCK in every process
 
-extern char trampoline[], uservec[], userret[];
+// nanosleep()ers wait for alarms, and recheck the time
+// whenever one goes off, on any hart.
+struct {
+  struct spinlock lock;
+  int nsleep;
+} alarms;
+
+extern char trampoline[], uservec[], userret[], syscallret[];
+extern uint64 mscratch0[];  // timervec's per-hart scratch areas, in start.c
 
 // in kernelvec.S, calls kerneltrap().
 void kernelvec();
@@ -20,6 +29,9 @@ void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  initlock(&alarms.lock, "alarms");
+  if((uclock = kalloc_zeroed()) == 0)
+    panic("trapinit");
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -27,17 +39,17 @@ void
 trapinithart(void)
 {
   w_stvec((uint64)kernelvec);
+  // let user code read the time with rdtime, for nanotime().
+  w_scounteren(r_scounteren() | 2);
 }
 
 //
-// handle an interrupt, exception, or system call from user space.
-// called from trampoline.S
+// handle an interrupt or exception from user space.
+// called from trampoline.S; system calls go to usersyscall().
 //
 void
 usertrap(void)
 {
-  int which_dev = 0;
-
   if((r_sstatus() & SSTATUS_SPP) != 0)
     panic("usertrap: not from user mode");
 
@@ -50,22 +62,18 @@ usertrap(void)
   // save user program counter.
   p->trapframe->epc = r_sepc();
   
-  if(r_scause() == 8){
-    // system call
-
-    if(p->killed)
-      exit(-1);
-
-    // sepc points to the ecall instruction,
-    // but we want to return to the next instruction.
-    p->trapframe->epc += 4;
-
-    // an interrupt will change sstatus &c registers,
-    // so don't enable until done with those registers.
+  if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){
+    // page fault; fine if the page was only swapped out.
+    // read the trap registers before an interrupt can change them.
+    uint64 scause = r_scause();
+    uint64 stval = r_stval();
     intr_on();
-
-    syscall();
-  } else if((which_dev = devintr()) != 0){
+    if(swapin(p, stval) < 0){
+      printf("usertrap(): unexpected scause %p pid=%d\n", scause, p->pid);
+      printf("            sepc=%p stval=%p\n", p->trapframe->epc, stval);
+      p->killed = 1;
+    }
+  } else if(devintr() != 0){
     // ok
   } else {
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
@@ -76,13 +84,61 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this was a timer interrupt, or another
+  // hart asked us to (see kickidle() in proc.c).
+  // meanwhile nothing in the kernel is using our user
+  // memory, so the swapper may take pages from it.
+  intr_off();
+  if(mycpu()->resched){
+    p->swapok = 1;
     yield();
+    p->swapok = 0;
+  }
 
   usertrapret();
 }
 
+//
+// handle a system call from user space: the fast path from
+// uservec, which has saved only the registers a function call
+// preserves, and goes straight back through syscallret.
+//
+void
+usersyscall(void)
+{
+  struct proc *p = myproc();
+
+  w_stvec((uint64)kernelvec);
+
+  // return to the instruction after the ecall.
+  p->trapframe->epc = r_sepc() + 4;
+
+  if(p->killed)
+    exit(-1);
+  intr_on();
+  syscall();
+  if(p->killed)
+    exit(-1);
+
+  intr_off();
+  w_stvec(TRAMPOLINE + (uservec - trampoline));
+
+  // usertrapret() set the rest of the trapframe's kernel_*
+  // before this process first ran, and they don't change; but
+  // it may have moved to another hart, or had its ASID
+  // reassigned.
+  p->trapframe->kernel_satp = r_satp();
+  p->trapframe->kernel_hartid = r_tp();
+
+  // sstatus may have been changed by a trap on another hart.
+  w_sstatus((r_sstatus() & ~SSTATUS_SPP) | SSTATUS_SPIE);
+  w_sepc(p->trapframe->epc);
+
+  uint64 satp = MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
+  uint64 fn = TRAMPOLINE + (syscallret - trampoline);
+  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+}
+
 //
 // return to user space
 //
@@ -104,6 +160,7 @@ usertrapret(void)
   p->trapframe->kernel_satp = r_satp();         // kernel page table
   p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
+  p->trapframe->kernel_syscall = (uint64)usersyscall;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
   // set up the registers that trampoline.S's sret will use
@@ -119,7 +176,7 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP(p->pagetable) | SATP_ASID(p->asid);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -133,7 +190,6 @@ usertrapret(void)
 void 
 kerneltrap()
 {
-  int which_dev = 0;
   uint64 sepc = r_sepc();
   uint64 sstatus = r_sstatus();
   uint64 scause = r_scause();
@@ -143,14 +199,16 @@ kerneltrap()
   if(intr_get() != 0)
     panic("kerneltrap: interrupts enabled");
 
-  if((which_dev = devintr()) == 0){
+  if(devintr() == 0){
     printf("scause %p\n", scause);
     printf("sepc=%p stval=%p\n", r_sepc(), r_stval());
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt, or another
+  // hart asked us to. interrupts were on, so no spinlock is
+  // held, and the interrupted code can be preempted.
+  if(mycpu()->resched && myproc() != 0 && myproc()->state == RUNNING)
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -164,8 +222,102 @@ clockintr()
 {
   acquire(&tickslock);
   ticks++;
+  uclock->ticks = ticks;
+  uclock->time = r_time();
   wakeup(&ticks);
   release(&tickslock);
+  polltick();  // for poll() and evwait() timeouts
+  evtick();
+}
+
+// ask machine mode for a timer interrupt on this hart at time
+// when (in CLINT cycles), as well as the usual ticks. the
+// interrupt comes even if when has passed.
+static void
+setalarm(uint64 when)
+{
+  register uint64 a0 asm("a0") = when;
+  register uint64 a7 asm("a7") = 0;
+
+  asm volatile("ecall" : : "r" (a0), "r" (a7) : "memory");
+}
+
+// interrupt hart, with a supervisor software interrupt, by
+// way of machine mode and the CLINT.
+void
+sendipi(int hart)
+{
+  register uint64 a0 asm("a0") = hart;
+  register uint64 a7 asm("a7") = 1;
+
+  asm volatile("ecall" : : "r" (a0), "r" (a7) : "memory");
+}
+
+// has timervec delivered a clock tick to this hart since the
+// last call? (rather than an alarm, or another hart's IPI.)
+static int
+clockticked(void)
+{
+
+  return __sync_lock_test_and_set(&mscratch0[32*cpuid() + 11], 0);
+}
+
+// has timervec delivered an alarm to this hart since the
+// last call?
+static int
+alarmfired(void)
+{
+  return __sync_lock_test_and_set(&mscratch0[32*cpuid() + 12], 0);
+}
+
+// Stop this hart's clock ticks while it is idle (idle = 1),
+// or restart them (idle = 0), so an idle hart only takes timer
+// interrupts for alarms. Hart 0 keeps ticking, to count ticks.
+void
+clockidle(int idle)
+{
+  int id = cpuid();
+
+  if(id == 0)
+    return;
+  mscratch0[32*id + 9] = idle;
+  setalarm(-1);  // have timervec reprogram the timer
+}
+
+// an alarm went off on this hart.
+static void
+alarmintr(void)
+{
+  __sync_synchronize();
+  if(alarms.nsleep == 0)
+    return;
+  acquire(&alarms.lock);
+  wakeup(&alarms);
+  release(&alarms.lock);
+}
+
+// Sleep until CLINT time deadline. Returns 0, or -1 if killed.
+int
+nanosleep(uint64 deadline)
+{
+  struct proc *p = myproc();
+
+  acquire(&alarms.lock);
+  alarms.nsleep++;
+  while(r_time() < deadline){
+    if(p->killed){
+      alarms.nsleep--;
+      release(&alarms.lock);
+      return -1;
+    }
+    // on whichever hart we're on now; interrupts are off, so
+    // the alarm can't be handled before we sleep.
+    setalarm(deadline);
+    sleep(&alarms, &alarms.lock);
+  }
+  alarms.nsleep--;
+  release(&alarms.lock);
+  return 0;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -202,15 +354,25 @@ devintr()
     return 1;
   } else if(scause == 0x8000000000000001L){
     // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // or another hart's sendipi(), forwarded by timervec in
+    // kernelvec.S.
+
+    // acknowledge the software interrupt by clearing
+    // the SSIP bit in sip, before looking at the time, so
+    // that an alarm that goes off meanwhile isn't lost.
+    w_sip(r_sip() & ~2);
 
+    // only alarms wake nanosleep()ers; waking them for IPIs
+    // too would have kickidle() send more IPIs, and so on.
+    if(alarmfired())
+      alarmintr();
+    if(!clockticked())
+      return 1;  // an alarm, or an IPI
     if(cpuid() == 0){
       clockintr();
     }
-    
-    // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
-    w_sip(r_sip() & ~2);
+    // time for another process to have this hart.
+    mycpu()->resched = 1;
 
     return 2;
   } else {
@@ -40,12 +40,12 @@
 
 // the transmit output buffer.
 struct spinlock uart_tx_lock;
-#define UART_TX_BUF_SIZE 32
+#define UART_TX_BUF_SIZE 1024
 char uart_tx_buf[UART_TX_BUF_SIZE];
 int uart_tx_w; // write next to uart_tx_buf[uart_tx_w++]
 int uart_tx_r; // read next from uart_tx_buf[uar_tx_r++]
 
-extern volatile int panicked; // from printf.c
+extern volatile int panicked; // from printf.c: panicking CPU + 1, or 0
 
 void uartstart();
 
@@ -89,6 +89,8 @@ uartputc(int c)
   acquire(&uart_tx_lock);
 
   if(panicked){
+    // freeze, but without the lock, which panic() needs.
+    release(&uart_tx_lock);
     for(;;)
       ;
   }
@@ -108,6 +110,57 @@ uartputc(int c)
   }
 }
 
+// add n characters to the output buffer, waiting for room as
+// needed, and start sending once per bufferful rather than
+// once per character. like uartputc(), only for write().
+void
+uartwrite(char *s, int n)
+{
+  int i = 0;
+
+  acquire(&uart_tx_lock);
+  if(panicked){
+    release(&uart_tx_lock);
+    for(;;)
+      ;
+  }
+  while(i < n){
+    if(((uart_tx_w + 1) % UART_TX_BUF_SIZE) == uart_tx_r){
+      // buffer is full.
+      sleep(&uart_tx_r, &uart_tx_lock);
+      continue;
+    }
+    while(i < n && ((uart_tx_w + 1) % UART_TX_BUF_SIZE) != uart_tx_r){
+      uart_tx_buf[uart_tx_w] = s[i++];
+      uart_tx_w = (uart_tx_w + 1) % UART_TX_BUF_SIZE;
+    }
+    uartstart();
+  }
+  release(&uart_tx_lock);
+}
+
+// add up to n characters to the output buffer without waiting,
+// for the kernel log. returns how many fit.
+int
+uartputs(char *s, int n)
+{
+  int i;
+
+  acquire(&uart_tx_lock);
+  if(panicked){
+    // leave it in the log; panic() will print it.
+    release(&uart_tx_lock);
+    return 0;
+  }
+  for(i = 0; i < n && ((uart_tx_w + 1) % UART_TX_BUF_SIZE) != uart_tx_r; i++){
+    uart_tx_buf[uart_tx_w] = s[i];
+    uart_tx_w = (uart_tx_w + 1) % UART_TX_BUF_SIZE;
+  }
+  uartstart();
+  release(&uart_tx_lock);
+  return i;
+}
+
 // alternate version of uartputc() that doesn't 
 // use interrupts, for use by kernel printf() and
 // to echo characters. it spins waiting for the uart's
@@ -117,7 +170,7 @@ uartputc_sync(int c)
 {
   push_off();
 
-  if(panicked){
+  if(panicked && panicked != cpuid() + 1){
     for(;;)
       ;
   }
@@ -134,9 +187,15 @@ uartputc_sync(int c)
 // in the transmit buffer, send it.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
+// doesn't wake writers waiting for room, since printf()
+// gets here, perhaps with a p->lock held; uartintr() does,
+// as the UART interrupts once it has sent what it was given.
 void
 uartstart()
 {
+  if(panicked)
+    return; // panic() sends the rest itself, synchronously.
+
   while(1){
     if(uart_tx_w == uart_tx_r){
       // transmit buffer is empty.
@@ -153,13 +212,28 @@ uartstart()
     int c = uart_tx_buf[uart_tx_r];
     uart_tx_r = (uart_tx_r + 1) % UART_TX_BUF_SIZE;
     
-    // maybe uartputc() is waiting for space in the buffer.
-    wakeup(&uart_tx_r);
-    
     WriteReg(THR, c);
   }
 }
 
+// for panic(): send whatever is still waiting in the
+// transmit buffer, synchronously. uartstart() no longer
+// runs, so this is exactly what hasn't gone out yet.
+void
+uartflush(void)
+{
+  int locked = holding(&uart_tx_lock);
+
+  if(!locked)
+    acquire(&uart_tx_lock);
+  while(uart_tx_r != uart_tx_w){
+    uartputc_sync(uart_tx_buf[uart_tx_r]);
+    uart_tx_r = (uart_tx_r + 1) % UART_TX_BUF_SIZE;
+  }
+  if(!locked)
+    release(&uart_tx_lock);
+}
+
 // read one input character from the UART.
 // return -1 if none is waiting.
 int
@@ -190,5 +264,10 @@ uartintr(void)
   // send buffered characters.
   acquire(&uart_tx_lock);
   uartstart();
+  // maybe uartputc() is waiting for space in the buffer.
+  wakeup(&uart_tx_r);
   release(&uart_tx_lock);
+
+  // and refill the buffer from the kernel log.
+  klogdrain();
 }
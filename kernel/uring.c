@@ -0,0 +1,99 @@
+//
+// Batched file operations through a pair of rings shared with
+// user space (see uring.h). A process queues reads and writes
+// in the submission ring and makes one uringenter() system
+// call to have them all done; results come back in the
+// completion ring. That saves a trap into the kernel and back
+// per operation.
+//
+// The rings live in one page, mapped at URING in the process
+// and reached by the kernel through its physical address. It
+// isn't inherited by fork() and goes away on exec() and exit.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "uring.h"
+
+// Map a fresh ring page into the current process, if it hasn't
+// one already. Returns its user address, or -1.
+uint64
+uringsetup(void)
+{
+  struct proc *p = myproc();
+  char *mem;
+
+  if(p->uring)
+    return URING;
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  if(mappages(p->pagetable, URING, PGSIZE, (uint64)mem, PTE_R|PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  p->uring = (struct uring*)mem;
+  kvmsyncuser(p);
+  return URING;
+}
+
+// Unmap and free p's ring, from pagetable: p's own, or the
+// one exec() is giving up.
+void
+uringfree(struct proc *p, pagetable_t pagetable)
+{
+  if(p->uring == 0)
+    return;
+  uvmunmap(pagetable, URING, 1, 1);
+  p->uring = 0;
+}
+
+static int
+urop(struct proc *p, struct ursqe *e)
+{
+  struct file *f;
+
+  if(e->op == UR_NOP)
+    return 0;
+  if(e->fd < 0 || e->fd >= NOFILE || (f = p->ofile[e->fd]) == 0 || e->n < 0)
+    return -1;
+  if(e->op == UR_READ)
+    return fileread(f, e->addr, e->n);
+  if(e->op == UR_WRITE)
+    return filewrite(f, e->addr, e->n);
+  return -1;
+}
+
+// Carry out up to n queued operations, as long as there is room
+// for their completions. Returns how many were done.
+int
+uringenter(int n)
+{
+  struct proc *p = myproc();
+  struct uring *r = p->uring;
+  struct ursqe e;
+  int i;
+
+  if(r == 0 || n < 0)
+    return -1;
+  for(i = 0; i < n && !p->killed; i++){
+    if(r->sqhead == r->sqtail || r->cqtail - r->cqhead >= NURING)
+      break;
+    __sync_synchronize();
+    // copy the entry, since the user can change it under us.
+    e = r->sq[r->sqhead % NURING];
+    r->sqhead++;
+    r->cq[r->cqtail % NURING].tag = e.tag;
+    r->cq[r->cqtail % NURING].res = urop(p, &e);
+    __sync_synchronize();
+    r->cqtail++;
+  }
+  return i;
+}
@@ -0,0 +1,34 @@
+// The submission and completion rings that uringsetup() maps
+// at URING, shared between a process and the kernel.
+
+#define NURING 64  // entries in each ring; a power of two
+
+// operations
+#define UR_NOP    0
+#define UR_READ   1
+#define UR_WRITE  2
+
+struct ursqe {
+  int op;        // UR_ operation
+  int fd;
+  uint64 addr;   // user buffer
+  int n;         // bytes
+  int tag;       // copied to the completion
+};
+
+struct urcqe {
+  int tag;
+  int res;       // what read() or write() would have returned
+};
+
+// the user adds at sqtail and the kernel takes from sqhead;
+// the kernel adds at cqtail and the user takes from cqhead.
+// indexes only grow, and are taken modulo NURING.
+struct uring {
+  volatile uint sqhead;
+  volatile uint sqtail;
+  volatile uint cqhead;
+  volatile uint cqtail;
+  struct ursqe sq[NURING];
+  struct urcqe cq[NURING];
+};
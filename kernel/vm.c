@@ -5,6 +5,8 @@
 #include "riscv.h"
 #include "defs.h"
 #include "fs.h"
+#include "spinlock.h"
+#include "proc.h"
 
 /*
  * the kernel's page table.
@@ -15,14 +17,16 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+static pte_t *walklevel(pagetable_t, uint64, int, int, int *);
+static void demote(pte_t *);
+
 /*
  * create a direct-map page table for the kernel.
  */
 void
 kvminit()
 {
-  kernel_pagetable = (pagetable_t) kalloc();
-  memset(kernel_pagetable, 0, PGSIZE);
+  kernel_pagetable = (pagetable_t) kalloc_zeroed();
 
   // uart registers
   kvmmap(UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -30,8 +34,9 @@ kvminit()
   // virtio mmio disk interface
   kvmmap(VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
-  // CLINT
-  kvmmap(CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+  // the CLINT is left unmapped: only machine mode uses it,
+  // and user memory lives at those addresses in the
+  // per-process kernel page tables.
 
   // PLIC
   kvmmap(PLIC, PLIC, 0x400000, PTE_R | PTE_W);
@@ -40,6 +45,7 @@ kvminit()
   kvmmap(KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // kvmmap() uses megapages for the aligned bulk of this range.
   kvmmap((uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -68,24 +74,54 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// A leaf PTE at level 1 maps a whole 2-megabyte megapage;
+// if va falls in one, walk() returns that level-1 PTE.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
+{
+  return walklevel(pagetable, va, alloc, 0, 0);
+}
+
+// Like walk(), but stop descending at level target (0 or 1).
+// If level is non-zero, set *level to the level of the
+// returned PTE, which is 1 for a megapage even if target is 0.
+static pte_t *
+walklevel(pagetable_t pagetable, uint64 va, int alloc, int target, int *level)
 {
   if(va >= MAXVA)
     panic("walk");
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
+  for(int l = 2; l > target; l--) {
+    pte_t *pte = &pagetable[PX(l, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte)){
+        if(l != 1)
+          panic("walk: gigapage");
+        if(level)
+          *level = l;
+        return pte;
+      }
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
-  return &pagetable[PX(0, va)];
+  if(level)
+    *level = target;
+  return &pagetable[PX(target, va)];
+}
+
+// Physical address of the page containing va, given the
+// leaf PTE and its level as returned by walklevel().
+static uint64
+leafpa(pte_t pte, int level, uint64 va)
+{
+  if(level == 1)
+    return PTE2PA(pte) + PGROUNDDOWN(va % MEGAPGSIZE);
+  return PTE2PA(pte);
 }
 
 // Look up a virtual address, return the physical address,
@@ -96,28 +132,30 @@ walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int level;
 
   if(va >= MAXVA)
     return 0;
 
-  pte = walk(pagetable, va, 0);
+  pte = walklevel(pagetable, va, 0, 0, &level);
   if(pte == 0)
     return 0;
   if((*pte & PTE_V) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
-  pa = PTE2PA(*pte);
+  pa = leafpa(*pte, level, va);
   return pa;
 }
 
-// add a mapping to the kernel page table.
+// add a mapping to the kernel page table,
+// using megapages where alignment allows.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kernel_pagetable, va, sz, pa, perm) != 0)
+  if(mapmegapages(kernel_pagetable, va, sz, pa, perm) != 0)
     panic("kvmmap");
 }
 
@@ -131,13 +169,14 @@ kvmpa(uint64 va)
   uint64 off = va % PGSIZE;
   pte_t *pte;
   uint64 pa;
+  int level;
   
-  pte = walk(kernel_pagetable, va, 0);
+  pte = walklevel(kernel_pagetable, va, 0, 0, &level);
   if(pte == 0)
     panic("kvmpa");
   if((*pte & PTE_V) == 0)
     panic("kvmpa");
-  pa = PTE2PA(*pte);
+  pa = leafpa(*pte, level, va);
   return pa+off;
 }
 
@@ -167,25 +206,119 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
   return 0;
 }
 
+// Map one megapage at megapage-aligned va to pa.
+// An existing level-1 page-table page there must be
+// empty (e.g. left behind by uvmdealloc()); it is freed.
+// Returns 0 on success, -1 if walk() couldn't allocate
+// a needed page-table page.
+static int
+mapmega(pagetable_t pagetable, uint64 va, uint64 pa, int perm)
+{
+  pte_t *pte;
+
+  if((pte = walklevel(pagetable, va, 1, 1, 0)) == 0)
+    return -1;
+  if(*pte & PTE_V){
+    if(PTE_LEAF(*pte))
+      panic("remap");
+    pagetable_t child = (pagetable_t)PTE2PA(*pte);
+    for(int i = 0; i < 512; i++)
+      if(child[i] & PTE_V)
+        panic("remap");
+    kfree((void*)child);
+  }
+  *pte = PA2PTE(pa) | perm | PTE_V;
+  return 0;
+}
+
+// Like mappages(), but use megapages for each 2-megabyte
+// stretch where both va and pa are megapage-aligned,
+// and 4096-byte pages elsewhere.
+int
+mapmegapages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
+{
+  uint64 a, end, n;
+
+  a = PGROUNDDOWN(va);
+  end = PGROUNDUP(va + size);
+  pa = PGROUNDDOWN(pa);
+  while(a < end){
+    if(a % MEGAPGSIZE == 0 && pa % MEGAPGSIZE == 0 && end - a >= MEGAPGSIZE){
+      if(mapmega(pagetable, a, pa, perm) != 0)
+        return -1;
+      n = MEGAPGSIZE;
+    } else {
+      // 4096-byte pages up to the next megapage boundary.
+      n = MEGAPGROUNDUP(a + 1) - a;
+      if(n > end - a)
+        n = end - a;
+      if(mappages(pagetable, a, n, pa, perm) != 0)
+        return -1;
+    }
+    a += n;
+    pa += n;
+  }
+  return 0;
+}
+
+// Split the megapage mapped by level-1 leaf *pte into
+// 512 ordinary PTEs in a new page-table page, with the
+// same permissions, so that part of it can be unmapped
+// or changed. Panics if no page-table page is free.
+static void
+demote(pte_t *pte)
+{
+  pagetable_t child;
+  uint64 pa = PTE2PA(*pte);
+  uint flags = PTE_FLAGS(*pte);
+
+  if((child = (pagetable_t)kalloc()) == 0)
+    panic("demote");
+  for(int i = 0; i < 512; i++)
+    child[i] = PA2PTE(pa + i*PGSIZE) | flags;
+  *pte = PA2PTE(child) | PTE_V;
+}
+
 // Remove npages of mappings starting from va. va must be
 // page-aligned. The mappings must exist.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
+  int level;
 
   if((va % PGSIZE) != 0)
     panic("uvmunmap: not aligned");
 
-  for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
-    if((pte = walk(pagetable, a, 0)) == 0)
+  end = va + npages*PGSIZE;
+  for(a = va; a < end; a += PGSIZE){
+    if((pte = walklevel(pagetable, a, 0, 0, &level)) == 0)
       panic("uvmunmap: walk");
+    if(*pte & PTE_S){
+      if(do_free)
+        swapfree(PTE2SLOT(*pte));
+      *pte = 0;
+      continue;
+    }
     if((*pte & PTE_V) == 0)
       panic("uvmunmap: not mapped");
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
+    if(level == 1){
+      if(a % MEGAPGSIZE == 0 && end - a >= MEGAPGSIZE){
+        // the whole megapage goes.
+        if(do_free)
+          kfreemega((void*)PTE2PA(*pte));
+        *pte = 0;
+        a += MEGAPGSIZE - PGSIZE;
+        continue;
+      }
+      // only part of it goes; split it up first.
+      demote(pte);
+      pte = walk(pagetable, a, 0);
+    }
     if(do_free){
       uint64 pa = PTE2PA(*pte);
       kfree((void*)pa);
@@ -194,16 +327,84 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
   }
 }
 
+// create a kernel page table for a process. it shares all of
+// kernel_pagetable's mappings except the first level-1 table,
+// which is private so that kvmsyncuser() can add the process's
+// user memory below USERTOP. returns 0 if out of memory.
+pagetable_t
+kvmcreate()
+{
+  pagetable_t kpt, l1, kl1;
+  int i;
+
+  if((kpt = (pagetable_t) kalloc_zeroed()) == 0)
+    return 0;
+  if((l1 = (pagetable_t) kalloc_zeroed()) == 0){
+    kfree(kpt);
+    return 0;
+  }
+  for(i = 1; i < 512; i++)
+    kpt[i] = kernel_pagetable[i];
+  kl1 = (pagetable_t)PTE2PA(kernel_pagetable[0]);
+  for(i = PX(1, USERTOP); i < 512; i++)
+    l1[i] = kl1[i];
+  kpt[0] = PA2PTE(l1) | PTE_V;
+  return kpt;
+}
+
+// make p's kernel page table map its user memory, by pointing
+// its level-1 entries below USERTOP at the same level-0 tables
+// and megapages as p->pagetable. needed whenever p's user
+// mappings change: after uvmalloc(), uvmdealloc() or uvmcopy().
+void
+kvmsyncuser(struct proc *p)
+{
+  pagetable_t l1 = (pagetable_t)PTE2PA(p->kpagetable[0]);
+  pagetable_t ul1 = 0;
+  int i;
+
+  if(p->pagetable[0] & PTE_V)
+    ul1 = (pagetable_t)PTE2PA(p->pagetable[0]);
+  for(i = 0; i < PX(1, USERTOP); i++)
+    l1[i] = ul1 ? ul1[i] : 0;
+  p->asidgen++;  // other harts must flush p's ASID
+  sfence_vma();
+}
+
+// how many ASID bits does this hart's satp implement?
+// write ones to the field and see which stick.
+int
+asidbits(void)
+{
+  uint64 satp = r_satp();
+  int n;
+
+  w_satp(satp | SATP_ASID(0xffff));
+  for(n = 0; n < 16 && (r_satp() & SATP_ASID(1L << n)); n++)
+    ;
+  w_satp(satp);
+  sfence_vma();
+  return n;
+}
+
+// free a page table made by kvmcreate(). the user memory
+// and the kernel's mappings belong to others.
+void
+kvmfree(pagetable_t kpt)
+{
+  kfree((void*)PTE2PA(kpt[0]));
+  kfree((void*)kpt);
+}
+
 // create an empty user page table.
 // returns 0 if out of memory.
 pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -236,12 +437,23 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    if(a % MEGAPGSIZE == 0 && newsz - a >= MEGAPGSIZE &&
+       (mem = kallocmega()) != 0){
+      // a large, aligned stretch: use a megapage.
+      memset(mem, 0, MEGAPGSIZE);
+      if(mapmega(pagetable, a, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+        kfreemega(mem);
+        uvmdealloc(pagetable, a, oldsz);
+        return 0;
+      }
+      a += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    mem = kalloc_zeroed();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -312,17 +524,35 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   uint64 pa, i;
   uint flags;
   char *mem;
+  int level;
 
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walk(old, i, 0)) == 0)
+    if((pte = walklevel(old, i, 0, 0, &level)) == 0)
       panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
+    if(level == 1 && i % MEGAPGSIZE == 0 && (mem = kallocmega()) != 0){
+      pa = PTE2PA(*pte);
+      flags = PTE_FLAGS(*pte);
+      memmove(mem, (char*)pa, MEGAPGSIZE);
+      if(mapmega(new, i, (uint64)mem, flags) != 0){
+        kfreemega(mem);
+        goto err;
+      }
+      i += MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    // no megapage free: copy it 4096 bytes at a time.
+    // kalloc() may swap pages of old out, this one included,
+    // so look at the PTE only after it.
     if((mem = kalloc()) == 0)
       goto err;
-    memmove(mem, (char*)pa, PGSIZE);
+    if(*pte & PTE_S){
+      swapread(mem, PTE2SLOT(*pte));
+      flags = (PTE_FLAGS(*pte) & ~PTE_S) | PTE_V;
+    } else if(*pte & PTE_V){
+      memmove(mem, (char*)leafpa(*pte, level, i), PGSIZE);
+      flags = PTE_FLAGS(*pte);
+    } else
+      panic("uvmcopy: page not present");
     if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
       kfree(mem);
       goto err;
@@ -341,13 +571,93 @@ void
 uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
+  int level;
   
-  pte = walk(pagetable, va, 0);
+  pte = walklevel(pagetable, va, 0, 0, &level);
   if(pte == 0)
     panic("uvmclear");
+  if(level == 1){
+    demote(pte);
+    pte = walk(pagetable, va, 0);
+  }
   *pte &= ~PTE_U;
 }
 
+// Run the swap clock hand over the user pages [va, sz):
+// clear the accessed bit of each resident page that has it,
+// and stop at the first one not accessed since the last pass.
+// Returns its address, or sz if there is none. Megapages
+// are never swapped out.
+uint64
+uvmclock(pagetable_t pagetable, uint64 va, uint64 sz)
+{
+  pte_t *pte;
+  int level;
+
+  for(va = PGROUNDDOWN(va); va < sz; va += PGSIZE){
+    if((pte = walklevel(pagetable, va, 0, 0, &level)) == 0)
+      continue;
+    if(level == 1){
+      va = MEGAPGROUNDDOWN(va) + MEGAPGSIZE - PGSIZE;
+      continue;
+    }
+    if((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0)
+      continue;
+    if((*pte & PTE_A) == 0)
+      return va;
+    *pte &= ~PTE_A;
+  }
+  return sz;
+}
+
+// Count the resident (not swapped-out) pages in [va, end).
+uint64
+uvmresident(pagetable_t pagetable, uint64 va, uint64 end)
+{
+  pte_t *pte;
+  uint64 n = 0;
+
+  for(va = PGROUNDDOWN(va); va < end; va += PGSIZE)
+    if((pte = walk(pagetable, va, 0)) != 0 && (*pte & PTE_V))
+      n++;
+  return n;
+}
+
+// Look up a user address for copyin() and friends, bringing
+// the page back from swap if it belongs to the current process
+// and we are allowed to sleep.
+static uint64
+uvaddr(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 pa;
+
+  pa = walkaddr(pagetable, va);
+  if(pa == 0 && intr_get() && p != 0 && p->pagetable == pagetable &&
+     swapin(p, va) == 0)
+    pa = walkaddr(pagetable, va);
+  return pa;
+}
+
+// Can [va, va+len) of pagetable be used directly through the
+// current process's kernel page table? Only if it is that
+// process's memory, none of it is swapped out, and none of it
+// is exec's stack guard page, which has no PTE_U but which
+// the kernel could still touch.
+static int
+direct(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || pagetable != p->pagetable ||
+     va + len < va || va + len > p->sz ||
+     p->rss != PGROUNDUP(p->sz) / PGSIZE)
+    return 0;
+  if(p->guard && va < p->guard + PGSIZE && va + len > p->guard)
+    return 0;
+  return 1;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -356,9 +666,16 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(direct(pagetable, dstva, len)){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    memmove((void *)dstva, src, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return 0;
+  }
+
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -381,9 +698,16 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
 
+  if(direct(pagetable, srcva, len)){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    memmove(dst, (void *)srcva, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return 0;
+  }
+
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -408,9 +732,28 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   uint64 n, va0, pa0;
   int got_null = 0;
 
+  if(direct(pagetable, srcva, 1)){
+    // stop at the end of user memory or at the guard page;
+    // the rest would fail.
+    struct proc *p = myproc();
+    n = p->sz - srcva;
+    if(p->guard && srcva < p->guard && p->guard - srcva < n)
+      n = p->guard - srcva;
+    if(n > max)
+      n = max;
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    for(char *s = (char *) srcva; n > 0; n--, s++, dst++)
+      if((*dst = *s) == '\0'){
+        got_null = 1;
+        break;
+      }
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return got_null ? 0 : -1;
+  }
+
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
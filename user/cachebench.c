@@ -0,0 +1,94 @@
+// Measure the effect of keeping processes on one hart: two
+// workers each sweep their own working set, then block for a
+// moment, so the scheduler decides where they run next over
+// and over. Run once free to go anywhere, and once with each
+// worker pinned to a hart of its own by setaffinity().
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/sysinfo.h"
+#include "user/user.h"
+
+#define NWORK 2
+#define ROUNDS 2000
+#define NPAGES 16   // working set per worker
+
+static char mem[NPAGES*PGSIZE];
+
+// how many times this process has changed harts.
+int
+nmigrate(void)
+{
+  static struct procinfo pi[NPROC];
+  int i, n, pid = getpid();
+
+  n = procinfo(pi, NPROC);
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid)
+      return pi[i].nmigrate;
+  return -1;
+}
+
+void
+work(void)
+{
+  int r, i;
+
+  for(r = 0; r < ROUNDS; r++){
+    for(i = 0; i < sizeof(mem); i += 64)
+      mem[i]++;
+    nanosleep(50000);
+  }
+}
+
+void
+run(int pin)
+{
+  int fds[2], i, n, moves = 0;
+  uint64 start;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "cachebench: pipe failed\n");
+    exit(1);
+  }
+  start = nanotime();
+  for(i = 0; i < NWORK; i++){
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "cachebench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      if(pin && setaffinity(1L << i) < 0){
+        fprintf(2, "cachebench: no hart %d\n", i);
+        exit(1);
+      }
+      work();
+      n = nmigrate();
+      write(fds[1], &n, sizeof(n));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  for(i = 0; i < NWORK; i++){
+    if(read(fds[0], &n, sizeof(n)) != sizeof(n)){
+      fprintf(2, "cachebench: worker failed\n");
+      exit(1);
+    }
+    moves += n;
+    wait(0);
+  }
+  close(fds[0]);
+  printf("cachebench: %s: %d ms, %d migrations\n", pin ? "pinned" : "free",
+         (int)((nanotime() - start) / 1000000), moves);
+}
+
+int
+main(int argc, char *argv[])
+{
+  run(0);
+  run(1);
+  exit(0);
+}
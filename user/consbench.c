@@ -0,0 +1,45 @@
+// Measure console output speed: write lines of text to the
+// console with write() calls of a few sizes, and report bytes
+// per second. The text itself scrolls by on the console.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define NBYTES (64*1024)
+#define HZ 10   // clock ticks per second (kernel/start.c's interval)
+
+static char buf[2*4096];
+static int sizes[] = { 1, 80, 4096 };
+
+// returns ticks taken.
+int
+bench(int bs)
+{
+  int n, start;
+
+  start = uptime();
+  for(n = 0; n < NBYTES; n += bs){
+    if(write(1, buf + n % 4096, bs) != bs){
+      fprintf(2, "consbench: write failed\n");
+      exit(1);
+    }
+  }
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, t[sizeof(sizes)/sizeof(sizes[0])];
+
+  // 79 characters and a newline, over and over.
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i % 80 == 79 ? '\n' : 'a' + i % 80 % 26;
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    t[i] = bench(sizes[i]);
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    printf("consbench: %d-byte writes: %d bytes in %d ticks (%d bytes/sec)\n",
+           sizes[i], NBYTES, t[i], t[i] ? NBYTES*HZ/t[i] : NBYTES*HZ);
+  exit(0);
+}
@@ -0,0 +1,49 @@
+// Measure wakeup latency: two processes pass a byte back and
+// forth over a pair of pipes. Each blocks in read() while the
+// other runs, so with more than one hart the reader is often
+// woken on a hart that was idle, which must be interrupted to
+// notice rather than wait for its next clock tick.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define ROUNDS 2000
+
+int
+main(int argc, char *argv[])
+{
+  int ab[2], ba[2], pid, i;
+  uint64 start;
+  char c = 0;
+
+  if(pipe(ab) < 0 || pipe(ba) < 0){
+    fprintf(2, "ipibench: pipe failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "ipibench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < ROUNDS; i++){
+      if(read(ab[0], &c, 1) != 1)
+        exit(1);
+      write(ba[1], &c, 1);
+    }
+    exit(0);
+  }
+  start = nanotime();
+  for(i = 0; i < ROUNDS; i++){
+    write(ab[1], &c, 1);
+    if(read(ba[0], &c, 1) != 1){
+      fprintf(2, "ipibench: read failed\n");
+      exit(1);
+    }
+  }
+  printf("ipibench: %d round trips: %d us each\n",
+         ROUNDS, (int)((nanotime() - start) / ROUNDS / 1000));
+  wait(0);
+  exit(0);
+}
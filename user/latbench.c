@@ -0,0 +1,63 @@
+// Measure scheduling latency under load: with every hart kept
+// busy by spinning processes, a process repeatedly sleeps for
+// a millisecond and sees how late it wakes. Prints the
+// kernel's histogram of waits to run over the same period.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sysinfo.h"
+#include "user/user.h"
+
+#define NHOG 4
+#define ROUNDS 200
+#define SLEEP 1000000  // ns
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo before, after;
+  int pids[NHOG], i;
+  uint64 t, late, total = 0, max = 0;
+
+  for(i = 0; i < NHOG; i++){
+    if((pids[i] = fork()) < 0){
+      fprintf(2, "latbench: fork failed\n");
+      exit(1);
+    }
+    if(pids[i] == 0)
+      for(;;)
+        ;
+  }
+
+  sysinfo(&before);
+  for(i = 0; i < ROUNDS; i++){
+    t = nanotime();
+    nanosleep(SLEEP);
+    late = nanotime() - t - SLEEP;
+    total += late;
+    if(late > max)
+      max = late;
+  }
+  sysinfo(&after);
+
+  for(i = 0; i < NHOG; i++){
+    kill(pids[i]);
+    wait(0);
+  }
+
+  printf("latbench: woke %d us late on average, %d us at worst\n",
+         (int)(total / ROUNDS / 1000), (int)(max / 1000));
+  printf("latbench: waits to run:\n");
+  for(i = 0; i < NSCHEDLAT; i++){
+    if(after.schedlat[i] == before.schedlat[i])
+      continue;
+    if(i == 0)
+      printf("  < 1 us");
+    else if(i == NSCHEDLAT - 1)
+      printf("  >= %d us", 1 << (i - 1));
+    else
+      printf("  %d-%d us", 1 << (i - 1), (1 << i) - 1);
+    printf(": %d\n", (int)(after.schedlat[i] - before.schedlat[i]));
+  }
+  exit(0);
+}
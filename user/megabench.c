@@ -0,0 +1,68 @@
+// Compare the cost of touching memory mapped with
+// 4096-byte pages against memory mapped with megapages.
+// Each pass touches one byte per page, so the run time
+// is dominated by TLB misses and page-table walks.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define REGION (8*1024*1024)
+#define ROUNDS 500
+
+// grow one page at a time, so the kernel never sees an
+// aligned 2-megabyte stretch and uses only small pages.
+char*
+smallpages(void)
+{
+  char *base = sbrk(0);
+
+  for(int i = 0; i < REGION/PGSIZE; i++){
+    if(sbrk(PGSIZE) == (char*)-1){
+      fprintf(2, "megabench: sbrk failed\n");
+      exit(1);
+    }
+  }
+  return base;
+}
+
+// grow by the whole region at a megapage boundary,
+// so the kernel can back it with megapages.
+char*
+megapages(void)
+{
+  uint64 cur = (uint64)sbrk(0);
+  char *base;
+
+  if(cur % MEGAPGSIZE)
+    sbrk(MEGAPGSIZE - cur % MEGAPGSIZE);
+  if((base = sbrk(REGION)) == (char*)-1){
+    fprintf(2, "megabench: sbrk failed\n");
+    exit(1);
+  }
+  return base;
+}
+
+int
+touch(char *base)
+{
+  int start = uptime();
+
+  for(int r = 0; r < ROUNDS; r++)
+    for(char *p = base; p < base + REGION; p += PGSIZE)
+      (*p)++;
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int t4k, t2m;
+
+  t4k = touch(smallpages());
+  t2m = touch(megapages());
+  printf("megabench: %d MB x %d rounds: 4K pages %d ticks, megapages %d ticks\n",
+         REGION/(1024*1024), ROUNDS, t4k, t2m);
+  exit(0);
+}
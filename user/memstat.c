@@ -0,0 +1,43 @@
+// memstat: print free and used memory, then the
+// memory use of each process, largest first.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/sysinfo.h"
+#include "user/user.h"
+
+static char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo si;
+  static struct procinfo pi[NPROC];
+  struct procinfo t;
+  int i, j, n;
+
+  if(sysinfo(&si) < 0 || (n = procinfo(pi, NPROC)) < 0){
+    fprintf(2, "memstat: failed\n");
+    exit(1);
+  }
+
+  printf("total %d KB  used %d KB  free %d KB  procs %d\n",
+         (int)(si.totalmem / 1024), (int)((si.totalmem - si.freemem) / 1024),
+         (int)(si.freemem / 1024), (int)si.nproc);
+
+  // sort by resident size.
+  for(i = 1; i < n; i++){
+    t = pi[i];
+    for(j = i; j > 0 && pi[j-1].rss < t.rss; j--)
+      pi[j] = pi[j-1];
+    pi[j] = t;
+  }
+
+  printf("pid\tstate\tsize KB\tres KB\tname\n");
+  for(i = 0; i < n; i++){
+    printf("%d\t%s\t%d\t%d\t%s\n", pi[i].pid,
+           pi[i].state >= 0 && pi[i].state < sizeof(states)/sizeof(states[0]) ? states[pi[i].state] : "???",
+           (int)(pi[i].sz / 1024), (int)(pi[i].rss / 1024), pi[i].name);
+  }
+  exit(0);
+}
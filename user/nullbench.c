@@ -0,0 +1,28 @@
+// Measure system call overhead with a call that does almost
+// nothing in the kernel: getpid() in a loop, as a system call
+// and as a read of the page the kernel shares with us.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+#define CALLS 1000000
+
+int
+main(int argc, char *argv[])
+{
+  uint64 start, t;
+  int i;
+
+  start = nanotime();
+  for(i = 0; i < CALLS; i++)
+    _getpid();
+  t = nanotime() - start;
+
+  start = nanotime();
+  for(i = 0; i < CALLS; i++)
+    getpid();
+  printf("nullbench: getpid(): %d ns as a system call, %d ns from the shared page\n",
+         (int)(t / CALLS), (int)((nanotime() - start) / CALLS));
+  exit(0);
+}
@@ -6,10 +6,104 @@
 
 static char digits[] = "0123456789ABCDEF";
 
+// Output is buffered per file descriptor, so that printf()
+// makes one write() per line or bufferful rather than one per
+// character. The console is flushed at each newline, other
+// files when the buffer fills, and fd 2 isn't buffered.
+// fflush() writes out one descriptor's buffer, or all of them;
+// exit(), fork(), exec(), spawn() and close() flush first, so
+// that output is neither lost nor printed twice.
+
+#define NOUTFD 16
+#define OUTBUF 512
+
+#define UNBUF   1
+#define LINEBUF 2
+#define FULLBUF 3
+
+static struct {
+  char mode;    // 0 until the first output to the fd
+  int n;        // bytes in buf
+  char buf[OUTBUF];
+} out[NOUTFD];
+
+// write out fd's buffer, or all buffers if fd is -1.
+void
+fflush(int fd)
+{
+  if(fd == -1){
+    for(fd = 0; fd < NOUTFD; fd++)
+      fflush(fd);
+    return;
+  }
+  if(fd < 0 || fd >= NOUTFD || out[fd].n == 0)
+    return;
+  write(fd, out[fd].buf, out[fd].n);
+  out[fd].n = 0;
+}
+
 static void
 putc(int fd, char c)
 {
-  write(fd, &c, 1);
+  struct stat st;
+
+  if(fd < 0 || fd >= NOUTFD){
+    write(fd, &c, 1);
+    return;
+  }
+  if(out[fd].mode == 0){
+    if(fd == 2 || fstat(fd, &st) < 0)
+      out[fd].mode = UNBUF;
+    else if(st.type == T_DEVICE)
+      out[fd].mode = LINEBUF;
+    else
+      out[fd].mode = FULLBUF;
+  }
+  if(out[fd].mode == UNBUF){
+    write(fd, &c, 1);
+    return;
+  }
+  out[fd].buf[out[fd].n++] = c;
+  if(out[fd].n == OUTBUF || (c == '\n' && out[fd].mode == LINEBUF))
+    fflush(fd);
+}
+
+int
+fork(void)
+{
+  fflush(-1);
+  return _fork();
+}
+
+int
+exit(int status)
+{
+  fflush(-1);
+  _exit(status);
+}
+
+int
+exec(char *path, char **argv)
+{
+  fflush(-1);
+  return _exec(path, argv);
+}
+
+int
+spawn(char *path, char **argv, struct spawnfd *acts, int nact)
+{
+  fflush(-1);
+  return _spawn(path, argv, acts, nact);
+}
+
+// the fd may next refer to some other file.
+int
+close(int fd)
+{
+  fflush(fd);
+  if(fd >= 0 && fd < NOUTFD)
+    out[fd].mode = 0;
+  return _close(fd);
 }
 
 static void
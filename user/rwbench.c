@@ -0,0 +1,93 @@
+// Measure read() and write() throughput with large buffers,
+// through a pipe and through a file, for a few buffer sizes.
+// Most of the kernel's work per byte is copying between user
+// and kernel memory.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define PIPEBYTES (4*1024*1024)
+#define FILEBYTES (256*1024)
+#define FILEROUNDS 8
+
+static char buf[64*1024];
+static int sizes[] = { 512, 4096, 65536 };
+
+int
+pipebench(int bs)
+{
+  int fds[2], pid, n, start;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "rwbench: pipe failed\n");
+    exit(1);
+  }
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "rwbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < PIPEBYTES; n += bs)
+      if(write(fds[1], buf, bs) != bs){
+        fprintf(2, "rwbench: pipe write failed\n");
+        exit(1);
+      }
+    exit(0);
+  }
+  close(fds[1]);
+  for(n = 0; n < PIPEBYTES; ){
+    int cc = read(fds[0], buf, bs);
+    if(cc <= 0){
+      fprintf(2, "rwbench: pipe read failed\n");
+      exit(1);
+    }
+    n += cc;
+  }
+  close(fds[0]);
+  wait(0);
+  return uptime() - start;
+}
+
+int
+filebench(int bs)
+{
+  int fd, n, r, start;
+
+  start = uptime();
+  if((fd = open("rwbench.tmp", O_CREATE|O_RDWR)) < 0){
+    fprintf(2, "rwbench: create failed\n");
+    exit(1);
+  }
+  for(n = 0; n < FILEBYTES; n += bs)
+    if(write(fd, buf, bs) != bs){
+      fprintf(2, "rwbench: file write failed\n");
+      exit(1);
+    }
+  close(fd);
+  for(r = 0; r < FILEROUNDS; r++){
+    if((fd = open("rwbench.tmp", O_RDONLY)) < 0){
+      fprintf(2, "rwbench: open failed\n");
+      exit(1);
+    }
+    while((n = read(fd, buf, bs)) > 0)
+      ;
+    close(fd);
+  }
+  unlink("rwbench.tmp");
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  for(int i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    printf("rwbench: %d-byte buffers: pipe %d MB in %d ticks, file %d KB x %d in %d ticks\n",
+           sizes[i], PIPEBYTES/(1024*1024), pipebench(sizes[i]),
+           FILEBYTES/1024, FILEROUNDS + 1, filebench(sizes[i]));
+  exit(0);
+}
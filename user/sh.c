@@ -3,6 +3,7 @@
 #include "kernel/types.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,6 +53,7 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void freecmd(struct cmd*);
 
 // Execute cmd.  Never returns.
 void
@@ -130,6 +132,79 @@ runcmd(struct cmd *cmd)
   exit(0);
 }
 
+// Can cmd be started with spawn() instead of fork() and exec()?
+// Plain commands, redirections and pipelines of them can.
+int
+spawnable(struct cmd *cmd)
+{
+  switch(cmd->type){
+  case EXEC:
+    return ((struct execcmd*)cmd)->argv[0] != 0;
+  case REDIR:
+    return spawnable(((struct redircmd*)cmd)->cmd);
+  case PIPE:
+    return spawnable(((struct pipecmd*)cmd)->left) &&
+           spawnable(((struct pipecmd*)cmd)->right);
+  }
+  return 0;
+}
+
+void
+setact(struct spawnfd *a, int op, int fd, int arg, char *path)
+{
+  a->op = op;
+  a->fd = fd;
+  a->arg = arg;
+  a->path = path;
+}
+
+// Start the programs of a spawnable cmd, giving each the file
+// actions acts[0..nact) before its own. The shell's descriptors
+// stay as they are. Returns the number of children started.
+int
+spawncmd(struct cmd *cmd, struct spawnfd *acts, int nact)
+{
+  int p[2], n;
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch(cmd->type){
+  case EXEC:
+    ecmd = (struct execcmd*)cmd;
+    if(spawn(ecmd->argv[0], ecmd->argv, acts, nact) < 0){
+      fprintf(2, "exec %s failed\n", ecmd->argv[0]);
+      return 0;
+    }
+    return 1;
+
+  case REDIR:
+    rcmd = (struct redircmd*)cmd;
+    if(nact + 1 > NSPAWNFD)
+      break;
+    setact(&acts[nact], SPAWN_OPEN, rcmd->fd, rcmd->mode, rcmd->file);
+    return spawncmd(rcmd->cmd, acts, nact + 1);
+
+  case PIPE:
+    pcmd = (struct pipecmd*)cmd;
+    if(nact + 3 > NSPAWNFD)
+      break;
+    if(pipe(p) < 0)
+      panic("pipe");
+    setact(&acts[nact], SPAWN_DUP2, 1, p[1], 0);
+    setact(&acts[nact+1], SPAWN_CLOSE, p[0], 0, 0);
+    setact(&acts[nact+2], SPAWN_CLOSE, p[1], 0, 0);
+    n = spawncmd(pcmd->left, acts, nact + 3);
+    setact(&acts[nact], SPAWN_DUP2, 0, p[0], 0);
+    n += spawncmd(pcmd->right, acts, nact + 3);
+    close(p[0]);
+    close(p[1]);
+    return n;
+  }
+  fprintf(2, "too many redirections\n");
+  return 0;
+}
+
 int
 getcmd(char *buf, int nbuf)
 {
@@ -145,7 +220,9 @@ int
 main(void)
 {
   static char buf[100];
-  int fd;
+  static struct spawnfd acts[NSPAWNFD];
+  struct cmd *cmd;
+  int fd, n;
 
   // Ensure that three file descriptors are open.
   while((fd = open("console", O_RDWR)) >= 0){
@@ -164,9 +241,18 @@ main(void)
         fprintf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait(0);
+    if((cmd = parsecmd(buf)) == 0)
+      continue;
+    if(spawnable(cmd)){
+      // no need to copy the shell only to replace the copy.
+      for(n = spawncmd(cmd, acts, 0); n > 0; n--)
+        wait(0);
+    } else {
+      if(fork1() == 0)
+        runcmd(cmd);
+      wait(0);
+    }
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -324,18 +410,36 @@ struct cmd *parsepipe(char**, char*);
 struct cmd *parseexec(char**, char*);
 struct cmd *nulterminate(struct cmd*);
 
+// The shell parses in the parent, which must not exit on a
+// syntax error, so the parser notes errors here and goes on.
+int badsyntax;
+
+void
+syntax(char *msg)
+{
+  if(!badsyntax)
+    fprintf(2, "%s\n", msg);
+  badsyntax = 1;
+}
+
+// Parse a command line. Returns 0 on a syntax error.
 struct cmd*
 parsecmd(char *s)
 {
   char *es;
   struct cmd *cmd;
 
+  badsyntax = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if(s != es){
+  if(s != es && !badsyntax){
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if(badsyntax){
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -379,8 +483,10 @@ parseredirs(struct cmd *cmd, char **ps, char *es)
 
   while(peek(ps, es, "<>")){
     tok = gettoken(ps, es, 0, 0);
-    if(gettoken(ps, es, &q, &eq) != 'a')
-      panic("missing file for redirection");
+    if(gettoken(ps, es, &q, &eq) != 'a'){
+      syntax("missing file for redirection");
+      break;
+    }
     switch(tok){
     case '<':
       cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -405,8 +511,10 @@ parseblock(char **ps, char *es)
     panic("parseblock");
   gettoken(ps, es, 0, 0);
   cmd = parseline(ps, es);
-  if(!peek(ps, es, ")"))
-    panic("syntax - missing )");
+  if(!peek(ps, es, ")")){
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -431,13 +539,17 @@ parseexec(char **ps, char *es)
   while(!peek(ps, es, "|)&;")){
     if((tok=gettoken(ps, es, &q, &eq)) == 0)
       break;
-    if(tok != 'a')
-      panic("syntax");
+    if(tok != 'a'){
+      syntax("syntax");
+      break;
+    }
+    if(argc >= MAXARGS-1){
+      syntax("too many args");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if(argc >= MAXARGS)
-      panic("too many args");
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -491,3 +603,32 @@ nulterminate(struct cmd *cmd)
   }
   return cmd;
 }
+
+// Free a command tree made by parsecmd().
+void
+freecmd(struct cmd *cmd)
+{
+  if(cmd == 0)
+    return;
+
+  switch(cmd->type){
+  case REDIR:
+    freecmd(((struct redircmd*)cmd)->cmd);
+    break;
+
+  case PIPE:
+    freecmd(((struct pipecmd*)cmd)->left);
+    freecmd(((struct pipecmd*)cmd)->right);
+    break;
+
+  case LIST:
+    freecmd(((struct listcmd*)cmd)->left);
+    freecmd(((struct listcmd*)cmd)->right);
+    break;
+
+  case BACK:
+    freecmd(((struct backcmd*)cmd)->cmd);
+    break;
+  }
+  free(cmd);
+}
@@ -0,0 +1,109 @@
+// Compare producer/consumer throughput through a pipe and
+// through a ring buffer in a shared memory segment. The pipe
+// copies every byte into the kernel and out again; the ring is
+// written and read in place, and only the head and tail
+// indexes pass between the two processes.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define NBYTES (4*1024*1024)
+#define CHUNK 4096
+#define NSLOT 64
+#define KEY 0x5bb
+
+struct ring {
+  volatile uint head;  // chunks written by the producer
+  volatile uint tail;  // chunks read by the consumer
+  char pad[PGSIZE - 2*sizeof(uint)];
+  char data[NSLOT][CHUNK];
+};
+
+static char buf[CHUNK];
+
+int
+pipebench(void)
+{
+  int fds[2], pid, n, start;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "shmbench: pipe failed\n");
+    exit(1);
+  }
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "shmbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < NBYTES; n += CHUNK){
+      memset(buf, n, CHUNK);
+      if(write(fds[1], buf, CHUNK) != CHUNK)
+        exit(1);
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  for(n = 0; n < NBYTES; ){
+    int cc = read(fds[0], buf, CHUNK);
+    if(cc <= 0){
+      fprintf(2, "shmbench: pipe read failed\n");
+      exit(1);
+    }
+    n += cc;
+  }
+  close(fds[0]);
+  wait(0);
+  return uptime() - start;
+}
+
+int
+shmbench(void)
+{
+  struct ring *r;
+  int pid, i, start;
+
+  r = shmmap(KEY, sizeof(struct ring));
+  if(r == (void*)-1){
+    fprintf(2, "shmbench: shmmap failed\n");
+    exit(1);
+  }
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "shmbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < NBYTES/CHUNK; i++){
+      while(r->head - r->tail == NSLOT)
+        ;
+      memset(r->data[i % NSLOT], i*CHUNK, CHUNK);
+      __sync_synchronize();
+      r->head++;
+    }
+    exit(0);
+  }
+  for(i = 0; i < NBYTES/CHUNK; i++){
+    while(r->head == r->tail)
+      ;
+    __sync_synchronize();
+    memmove(buf, r->data[i % NSLOT], CHUNK);
+    r->tail++;
+  }
+  wait(0);
+  shmunmap(KEY);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("shmbench: %d MB in %d-byte chunks: pipe %d ticks, shared memory %d ticks\n",
+         NBYTES/(1024*1024), CHUNK, pipebench(), shmbench());
+  exit(0);
+}
@@ -0,0 +1,62 @@
+// Measure context-switch cost: two processes pass a byte back
+// and forth over a pair of pipes, and each touches a few pages
+// of its own memory every time it runs. Without ASIDs every
+// switch flushes the TLB, so those touches all miss.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+#define ROUNDS 20000
+#define NTOUCH 16
+
+static char mem[NTOUCH*PGSIZE];
+
+void
+touch(void)
+{
+  for(int i = 0; i < NTOUCH; i++)
+    mem[i*PGSIZE]++;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int ab[2], ba[2], pid, start, i;
+  char c = 0;
+
+  if(pipe(ab) < 0 || pipe(ba) < 0){
+    fprintf(2, "switchbench: pipe failed\n");
+    exit(1);
+  }
+  touch();
+
+  start = uptime();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "switchbench: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < ROUNDS; i++){
+      if(read(ab[0], &c, 1) != 1)
+        exit(1);
+      touch();
+      write(ba[1], &c, 1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < ROUNDS; i++){
+    write(ab[1], &c, 1);
+    if(read(ba[0], &c, 1) != 1){
+      fprintf(2, "switchbench: read failed\n");
+      exit(1);
+    }
+    touch();
+  }
+  wait(0);
+  printf("switchbench: %d round trips, touching %d pages each switch: %d ticks\n",
+         ROUNDS, NTOUCH, uptime() - start);
+  exit(0);
+}
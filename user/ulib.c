@@ -1,6 +1,8 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
 #include "user/user.h"
 
 char*
@@ -134,3 +136,33 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// getpid() and uptime() read pages the kernel maps into every
+// process, without a system call.
+int
+getpid(void)
+{
+  return ((volatile struct usyscall*)USYSCALL)->pid;
+}
+
+int
+uptime(void)
+{
+  return ((volatile struct uclock*)UCLOCK)->ticks;
+}
+
+// the CLINT's time (in cycles) at the latest clock tick.
+uint64
+clinttime(void)
+{
+  return ((volatile struct uclock*)UCLOCK)->time;
+}
+
+// nanoseconds since boot, from the CLINT's time, which the
+// kernel lets user code read directly.
+uint64
+nanotime(void)
+{
+  return r_time() * CLINT_NS;
+}
+
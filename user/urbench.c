@@ -0,0 +1,145 @@
+// Measure small reads and writes made one system call each,
+// and batched through the submission ring. Each operation moves
+// only 16 bytes, so the cost of entering and leaving the kernel
+// dominates: writes and reads through a pipe, and reads of a
+// cached file. (File writes would measure the disk instead.)
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/uring.h"
+#include "user/user.h"
+
+#define NOPS 16384
+#define BS 16
+#define BATCH 32
+
+static char buf[BS];
+static struct uring *r;
+
+void
+queue(int op, int fd)
+{
+  struct ursqe *e = &r->sq[r->sqtail % NURING];
+
+  e->op = op;
+  e->fd = fd;
+  e->addr = (uint64)buf;
+  e->n = BS;
+  e->tag = r->sqtail;
+  r->sqtail++;
+}
+
+// submit n queued operations and check their results.
+void
+submit(int n)
+{
+  if(uringenter(n) != n){
+    fprintf(2, "urbench: uringenter failed\n");
+    exit(1);
+  }
+  for(; r->cqhead != r->cqtail; r->cqhead++){
+    if(r->cq[r->cqhead % NURING].res != BS){
+      fprintf(2, "urbench: operation %d failed\n", r->cq[r->cqhead % NURING].tag);
+      exit(1);
+    }
+  }
+}
+
+void
+check(int cc)
+{
+  if(cc != BS){
+    fprintf(2, "urbench: read or write failed\n");
+    exit(1);
+  }
+}
+
+// NOPS operations: alternate writes and reads through a pipe.
+void
+pipes(void)
+{
+  int fds[2], i, j, t0, t1, t2;
+
+  if(pipe(fds) < 0){
+    fprintf(2, "urbench: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  for(i = 0; i < NOPS; i += 2){
+    check(write(fds[1], buf, BS));
+    check(read(fds[0], buf, BS));
+  }
+  t1 = uptime();
+  for(i = 0; i < NOPS; i += 2*BATCH){
+    for(j = 0; j < BATCH; j++)
+      queue(UR_WRITE, fds[1]);
+    for(j = 0; j < BATCH; j++)
+      queue(UR_READ, fds[0]);
+    submit(2*BATCH);
+  }
+  t2 = uptime();
+  close(fds[0]);
+  close(fds[1]);
+  printf("urbench: %d %d-byte pipe writes and reads: %d ticks one call each, %d ticks in batches of %d\n",
+         NOPS, BS, t1 - t0, t2 - t1, 2*BATCH);
+}
+
+// NOPS reads of a file small enough to stay in the buffer
+// cache, reopened each time through.
+#define FILEBYTES (16*1024)
+
+int
+reopen(int fd)
+{
+  close(fd);
+  if((fd = open("urbench.tmp", O_RDONLY)) < 0){
+    fprintf(2, "urbench: open failed\n");
+    exit(1);
+  }
+  return fd;
+}
+
+void
+files(void)
+{
+  int fd, i, j, t0, t1, t2;
+
+  if((fd = open("urbench.tmp", O_CREATE|O_WRONLY)) < 0){
+    fprintf(2, "urbench: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < FILEBYTES; i += BS)
+    check(write(fd, buf, BS));
+  t0 = uptime();
+  for(i = 0; i < NOPS; i++){
+    if(i % (FILEBYTES/BS) == 0)
+      fd = reopen(fd);
+    check(read(fd, buf, BS));
+  }
+  t1 = uptime();
+  for(i = 0; i < NOPS; i += BATCH){
+    if(i % (FILEBYTES/BS) == 0)
+      fd = reopen(fd);
+    for(j = 0; j < BATCH; j++)
+      queue(UR_READ, fd);
+    submit(BATCH);
+  }
+  t2 = uptime();
+  close(fd);
+  unlink("urbench.tmp");
+  printf("urbench: %d %d-byte file reads: %d ticks one call each, %d ticks in batches of %d\n",
+         NOPS, BS, t1 - t0, t2 - t1, BATCH);
+}
+
+int
+main(int argc, char *argv[])
+{
+  if((r = uringsetup()) == (struct uring*)-1){
+    fprintf(2, "urbench: uringsetup failed\n");
+    exit(1);
+  }
+  pipes();
+  files();
+  exit(0);
+}
@@ -1,5 +1,10 @@
 struct stat;
 struct rtcdate;
+struct sysinfo;
+struct procinfo;
+struct spawnfd;
+struct pollfd;
+struct uring;
 
 // system calls
 int fork(void);
@@ -23,6 +28,31 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int sysinfo(struct sysinfo*);
+int procinfo(struct procinfo*, int);
+int spawn(char*, char**, struct spawnfd*, int);
+void *shmmap(int, int);
+int shmunmap(int);
+int splice(int, int, int);
+int fcntl(int, int, int);
+int poll(struct pollfd*, int, int);
+int evqueue(void);
+int evctl(int, int, int, int);
+int evwait(int, struct pollfd*, int, int);
+struct uring *uringsetup(void);
+int uringenter(int);
+int dmesg(char*, int);
+int nanosleep(uint64);
+int setaffinity(uint64);
+
+// system call stubs wrapped by printf.c, or replaced by ulib.c
+int _fork(void);
+int _exit(int) __attribute__((noreturn));
+int _exec(char*, char**);
+int _spawn(char*, char**, struct spawnfd*, int);
+int _close(int);
+int _getpid(void);
+int _uptime(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -32,6 +62,7 @@ char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void fprintf(int, const char*, ...);
 void printf(const char*, ...);
+void fflush(int);
 char* gets(char*, int max);
 uint strlen(const char*);
 void* memset(void*, int, uint);
@@ -40,3 +71,5 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+uint64 clinttime(void);
+uint64 nanotime(void);
@@ -7,6 +7,10 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sysinfo.h"
+#include "kernel/spawn.h"
+#include "kernel/poll.h"
+#include "kernel/uring.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -680,6 +684,704 @@ exectest(char *s)
 
 }
 
+// spawn() with file actions, like exectest.
+void
+spawntest(char *s)
+{
+  int fd, xstatus, pid;
+  char *echoargv[] = { "echo", "OK", 0 };
+  struct spawnfd acts[2];
+  char buf[3];
+
+  unlink("echo-ok");
+  acts[0].op = SPAWN_OPEN;
+  acts[0].fd = 1;
+  acts[0].arg = O_CREATE|O_WRONLY;
+  acts[0].path = "echo-ok";
+  if((pid = spawn("echo", echoargv, acts, 1)) < 0){
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: wait failed\n", s);
+    exit(1);
+  }
+  fd = open("echo-ok", O_RDONLY);
+  if(fd < 0 || read(fd, buf, 2) != 2 || buf[0] != 'O' || buf[1] != 'K'){
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("echo-ok");
+
+  if(spawn("nonexistent", echoargv, 0, 0) >= 0){
+    printf("%s: spawn of nonexistent file succeeded\n", s);
+    exit(1);
+  }
+  acts[0].op = SPAWN_DUP2;
+  acts[0].fd = 3;
+  acts[0].arg = NOFILE + 1;
+  if(spawn("echo", echoargv, acts, 1) >= 0){
+    printf("%s: spawn with bad action succeeded\n", s);
+    exit(1);
+  }
+}
+
+// pipe data wrapping around the buffer many times, written and
+// read in sizes that don't divide its size or each other.
+void
+pipebig(char *s)
+{
+  int fds[2], pid, xstatus, i, n, cc;
+  enum { N=200*1024, WSZ=3001, RSZ=7919 };
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < N; n += cc){
+      cc = N - n < WSZ ? N - n : WSZ;
+      for(i = 0; i < cc; i++)
+        buf[i] = (n + i) % 251;
+      if(write(fds[1], buf, cc) != cc){
+        printf("%s: pipe write failed\n", s);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  close(fds[1]);
+  for(n = 0; (cc = read(fds[0], buf, RSZ)) > 0; n += cc){
+    for(i = 0; i < cc; i++){
+      if((buf[i] & 0xff) != (n + i) % 251){
+        printf("%s: pipe data wrong at %d\n", s, n + i);
+        exit(1);
+      }
+    }
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(n != N || xstatus != 0){
+    printf("%s: read %d bytes of %d\n", s, n, N);
+    exit(1);
+  }
+}
+
+// splice() from a file into a pipe, from the pipe into
+// another file, and from file to file.
+void
+splicetest(char *s)
+{
+  int fd, fd2, fds[2], i, n;
+  enum { N=5000 };
+
+  for(i = 0; i < N; i++)
+    buf[i] = i % 239;
+  unlink("splice0");
+  unlink("splice1");
+  fd = open("splice0", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, buf, N) != N){
+    printf("%s: create splice0 failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fd = open("splice0", O_RDONLY);
+  if((n = splice(fd, fds[1], N + 100)) != N){
+    printf("%s: splice file to pipe returned %d\n", s, n);
+    exit(1);
+  }
+  close(fd);
+  close(fds[1]);
+  fd = open("splice1", O_CREATE|O_RDWR);
+  if((n = splice(fds[0], fd, N + 100)) != N){
+    printf("%s: splice pipe to file returned %d\n", s, n);
+    exit(1);
+  }
+  close(fds[0]);
+  if(splice(fd, 1, 10) != -1 || splice(fd, fd, -1) != -1){
+    printf("%s: bad splice succeeded\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  fd = open("splice1", O_RDONLY);
+  fd2 = open("splice0", O_CREATE|O_WRONLY);
+  if(splice(fd, fd2, N) != N){
+    printf("%s: splice file to file failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(fd2);
+
+  memset(buf, 0, N);
+  fd = open("splice0", O_RDONLY);
+  if(read(fd, buf, N + 1) != N){
+    printf("%s: wrong length\n", s);
+    exit(1);
+  }
+  close(fd);
+  for(i = 0; i < N; i++){
+    if((buf[i] & 0xff) != i % 239){
+      printf("%s: wrong data at %d\n", s, i);
+      exit(1);
+    }
+  }
+  unlink("splice0");
+  unlink("splice1");
+}
+
+// O_NONBLOCK pipes, and poll() on them.
+void
+polltest(char *s)
+{
+  int fds[2], pid, xstatus, n, cc, t;
+  struct pollfd pfd[2];
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLIN|POLLOUT;
+  if(poll(pfd, 2, 0) != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLOUT){
+    printf("%s: poll of empty pipe wrong\n", s);
+    exit(1);
+  }
+  t = uptime();
+  if(poll(pfd, 1, 2) != 0 || uptime() - t < 2){
+    printf("%s: poll timeout wrong\n", s);
+    exit(1);
+  }
+
+  if(fcntl(fds[0], F_SETFL, O_NONBLOCK) != 0 ||
+     fcntl(fds[0], F_GETFL, 0) != (O_RDONLY|O_NONBLOCK) ||
+     read(fds[0], buf, 1) != -1){
+    printf("%s: non-blocking read of empty pipe wrong\n", s);
+    exit(1);
+  }
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  for(n = 0; (cc = write(fds[1], buf, 1000)) > 0; n += cc)
+    ;
+  if(n == 0 || poll(&pfd[1], 1, 0) != 0){
+    printf("%s: full pipe wrong\n", s);
+    exit(1);
+  }
+  while((cc = read(fds[0], buf, sizeof(buf))) > 0)
+    n -= cc;
+  if(n != 0){
+    printf("%s: lost %d bytes\n", s, n);
+    exit(1);
+  }
+
+  // wait for a child's write.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(fds[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLIN ||
+     read(fds[0], buf, 1) != 1 || buf[0] != 'x'){
+    printf("%s: poll for child's write failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+
+  close(fds[1]);
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != (POLLIN|POLLHUP) ||
+     read(fds[0], buf, 1) != 0){
+    printf("%s: poll of closed pipe wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  pfd[0].fd = fds[0];
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != POLLNVAL){
+    printf("%s: poll of closed fd wrong\n", s);
+    exit(1);
+  }
+}
+
+// an event queue watching two pipes.
+void
+evqtest(char *s)
+{
+  int q, a[2], b[2], fd, pid, xstatus;
+  struct pollfd ev[4];
+
+  if((q = evqueue()) < 0 || pipe(a) != 0 || pipe(b) != 0){
+    printf("%s: evqueue or pipe failed\n", s);
+    exit(1);
+  }
+  if(evctl(q, EV_ADD, a[0], POLLIN) != 0 || evctl(q, EV_ADD, b[0], POLLIN) != 0 ||
+     evctl(q, EV_ADD, b[0], POLLIN) != -1 || evctl(q, EV_DEL, a[1], 0) != -1){
+    printf("%s: evctl failed\n", s);
+    exit(1);
+  }
+  fd = open("README", O_RDONLY);
+  if(fd < 0 || evctl(q, EV_ADD, fd, POLLIN) != -1){
+    printf("%s: watched a disk file\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(evwait(q, ev, 4, 0) != 0){
+    printf("%s: events on empty pipes\n", s);
+    exit(1);
+  }
+
+  // level triggered: reported until read.
+  write(b[1], "x", 1);
+  if(evwait(q, ev, 4, 0) != 1 || ev[0].fd != b[0] || ev[0].revents != POLLIN ||
+     evwait(q, ev, 4, -1) != 1 || ev[0].fd != b[0]){
+    printf("%s: no event for written pipe\n", s);
+    exit(1);
+  }
+  read(b[0], buf, 1);
+  if(evwait(q, ev, 4, 1) != 0){
+    printf("%s: event after pipe was read\n", s);
+    exit(1);
+  }
+
+  // a child's write wakes us up.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sleep(2);
+    write(a[1], "y", 1);
+    exit(0);
+  }
+  if(evwait(q, ev, 4, -1) != 1 || ev[0].fd != a[0] || ev[0].revents != POLLIN){
+    printf("%s: no event for child's write\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  read(a[0], buf, 1);
+
+  close(b[1]);
+  if(evwait(q, ev, 4, 0) != 1 || ev[0].fd != b[0] || ev[0].revents != (POLLIN|POLLHUP)){
+    printf("%s: no event for closed pipe\n", s);
+    exit(1);
+  }
+  if(evctl(q, EV_DEL, b[0], 0) != 0 || evwait(q, ev, 4, 0) != 0){
+    printf("%s: event after EV_DEL\n", s);
+    exit(1);
+  }
+  // closing a watched pipe drops the watch.
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(q);
+}
+
+// operations batched through the submission ring.
+void
+uringtest(char *s)
+{
+  struct uring *r;
+  int fds[2], pid, xstatus, i;
+  static struct ursqe ops[] = {
+    { UR_WRITE, 0, 0, 5, 10 },
+    { UR_READ,  0, 0, 5, 11 },
+    { UR_NOP,   0, 0, 0, 12 },
+    { UR_READ,  NOFILE, 0, 5, 13 },
+  };
+  int res[] = { 5, 5, 0, -1 };
+
+  if(uringenter(1) != -1){
+    printf("%s: uringenter without a ring succeeded\n", s);
+    exit(1);
+  }
+  r = uringsetup();
+  if(r == (struct uring*)-1 || uringsetup() != r || r->sqtail != 0){
+    printf("%s: uringsetup failed\n", s);
+    exit(1);
+  }
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  ops[0].fd = fds[1];
+  ops[0].addr = (uint64)"hello";
+  ops[1].fd = fds[0];
+  ops[1].addr = (uint64)buf;
+  for(i = 0; i < 4; i++)
+    r->sq[r->sqtail++ % NURING] = ops[i];
+  if(uringenter(10) != 4 || r->sqhead != 4 || r->cqtail != 4){
+    printf("%s: uringenter didn't take all operations\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 4; i++){
+    if(r->cq[i].tag != ops[i].tag || r->cq[i].res != res[i]){
+      printf("%s: completion %d wrong\n", s, i);
+      exit(1);
+    }
+  }
+  r->cqhead = 4;
+  if(memcmp(buf, "hello", 5) != 0){
+    printf("%s: read through ring wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // the ring isn't inherited.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(uringenter(1) == -1 ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child had a ring\n", s);
+    exit(1);
+  }
+}
+
+// system calls made by this process so far, counting the
+// procinfo() that asks.
+int
+nsyscall(void)
+{
+  static struct procinfo pi[NPROC];
+  int i, n, pid = getpid();
+
+  n = procinfo(pi, NPROC);
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid)
+      return pi[i].nsyscall;
+  return -1;
+}
+
+// buffered printf(): count the system calls needed to print
+// to a pipe, against one per character unbuffered.
+void
+stdiotest(char *s)
+{
+  int fds[2], i, n, before, calls, chars;
+  char *line = "the quick brown fox jumps over the lazy dog";
+
+  if(pipe(fds) != 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  before = nsyscall();
+  for(i = 0; i < 10; i++)
+    fprintf(fds[1], "%s %d\n", line, i);
+  fflush(fds[1]);
+  // one procinfo(), one fstat() to see that it's a pipe,
+  // and one write().
+  calls = nsyscall() - before - 1;
+  chars = 10 * (strlen(line) + 3);
+  if(calls > 3){
+    printf("%s: %d system calls for %d characters\n", s, calls, chars);
+    exit(1);
+  }
+  n = read(fds[0], buf, sizeof(buf));
+  if(n != chars || memcmp(buf, line, strlen(line)) != 0 ||
+     memcmp(buf + chars - 3, " 9\n", 3) != 0){
+    printf("%s: read back %d characters, wanted %d\n", s, n, chars);
+    exit(1);
+  }
+
+  // close() flushes.
+  fprintf(fds[1], "x");
+  close(fds[1]);
+  if(read(fds[0], buf, sizeof(buf)) != 1 || buf[0] != 'x'){
+    printf("%s: close didn't flush\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
+// a system call keeps the registers a function call keeps
+// (but s0 is the frame pointer, so leave it alone), and
+// clears the temporaries rather than leak kernel values.
+void
+sysregs(char *s)
+{
+  uint64 bad;
+
+  asm volatile(
+    "li s1, 101\n li s2, 102\n li s3, 103\n"
+    "li s4, 104\n li s5, 105\n li s6, 106\n li s7, 107\n"
+    "li s8, 108\n li s9, 109\n li s10, 110\n li s11, 111\n"
+    "li t0, 1\n li t1, 1\n li t2, 1\n li t3, 1\n li t4, 1\n li t5, 1\n li t6, 1\n"
+    "li a7, %1\n"
+    "ecall\n"
+    "or %0, t0, t1\n or %0, %0, t2\n or %0, %0, t3\n"
+    "or %0, %0, t4\n or %0, %0, t5\n or %0, %0, t6\n"
+    "addi s1, s1, -101\n or %0, %0, s1\n"
+    "addi s2, s2, -102\n or %0, %0, s2\n"
+    "addi s3, s3, -103\n or %0, %0, s3\n"
+    "addi s4, s4, -104\n or %0, %0, s4\n"
+    "addi s5, s5, -105\n or %0, %0, s5\n"
+    "addi s6, s6, -106\n or %0, %0, s6\n"
+    "addi s7, s7, -107\n or %0, %0, s7\n"
+    "addi s8, s8, -108\n or %0, %0, s8\n"
+    "addi s9, s9, -109\n or %0, %0, s9\n"
+    "addi s10, s10, -110\n or %0, %0, s10\n"
+    "addi s11, s11, -111\n or %0, %0, s11\n"
+    : "=&r" (bad)
+    : "i" (SYS_getpid)
+    : "a0", "a7", "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+      "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+      "memory");
+  if(bad){
+    printf("%s: registers not preserved across a system call\n", s);
+    exit(1);
+  }
+}
+
+// getpid() and uptime() from the shared pages agree with the
+// system calls, in a child as well.
+void
+upagetest(char *s)
+{
+  int pid, xstatus, t;
+
+  if(getpid() != _getpid()){
+    printf("%s: getpid() %d, system call says %d\n", s, getpid(), _getpid());
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
+    exit(getpid() == _getpid() ? 0 : 1);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: wrong pid in child\n", s);
+    exit(1);
+  }
+  t = _uptime();
+  if(uptime() < t || uptime() > t + 1){
+    printf("%s: uptime() %d, system call says %d\n", s, uptime(), t);
+    exit(1);
+  }
+  // the pages are read-only.
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile int*)USYSCALL = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: wrote to the pid page\n", s);
+    exit(1);
+  }
+}
+
+// nanotime() goes forward, and nanosleep() sleeps at least as
+// long as asked, but wakes well before the next clock tick.
+void
+nanosleeptest(char *s)
+{
+  uint64 start, t;
+  int i;
+
+  start = nanotime();
+  if(nanotime() < start){
+    printf("%s: time went backwards\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++){
+    t = nanotime();
+    if(nanosleep(1000000) != 0){
+      printf("%s: nanosleep failed\n", s);
+      exit(1);
+    }
+    if(nanotime() - t < 1000000){
+      printf("%s: woke after %d ns\n", s, (int)(nanotime() - t));
+      exit(1);
+    }
+  }
+  // ten ticks' worth if each sleep waited for a tick.
+  t = nanotime() - start;
+  if(t > 500000000){
+    printf("%s: ten 1 ms sleeps took %d ms\n", s, (int)(t / 1000000));
+    exit(1);
+  }
+}
+
+// a process pinned to hart 0 stays there; one allowed no
+// running hart is refused.
+void
+affinitytest(char *s)
+{
+  static struct procinfo pi[NPROC];
+  int i, n, n2, pid = getpid();
+
+  if(setaffinity(0) != -1){
+    printf("%s: setaffinity(0) succeeded\n", s);
+    exit(1);
+  }
+  if(setaffinity(1) != 0){
+    printf("%s: setaffinity(1) failed\n", s);
+    exit(1);
+  }
+  n = procinfo(pi, NPROC);
+  for(i = 0; i < n && pi[i].pid != pid; i++)
+    ;
+  if(i == n){
+    printf("%s: procinfo failed\n", s);
+    exit(1);
+  }
+  // setaffinity() has moved us to hart 0 if need be; after
+  // that, blocking and waking shouldn't move us again.
+  n = pi[i].nmigrate;
+  for(i = 0; i < 20; i++)
+    nanosleep(100000);
+  n2 = procinfo(pi, NPROC);
+  for(i = 0; i < n2 && pi[i].pid != pid; i++)
+    ;
+  if(i == n2 || pi[i].nmigrate != n){
+    printf("%s: pinned process moved %d times\n", s, (int)(pi[i].nmigrate - n));
+    exit(1);
+  }
+  setaffinity(-1);
+}
+
+// each time a process is scheduled, its wait is counted in
+// the latency histogram.
+void
+schedlattest(char *s)
+{
+  struct sysinfo before, after;
+  uint64 n = 0;
+  int i;
+
+  if(sysinfo(&before) < 0){
+    printf("%s: sysinfo failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 5; i++)
+    nanosleep(100000);
+  sysinfo(&after);
+  for(i = 0; i < NSCHEDLAT; i++)
+    n += after.schedlat[i] - before.schedlat[i];
+  if(n < 5){
+    printf("%s: %d waits counted for 5 sleeps\n", s, (int)n);
+    exit(1);
+  }
+}
+
+// a child's fault is reported in the kernel log.
+void
+dmesgtest(char *s)
+{
+  char want[32], *p;
+  int i, n, pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    *(volatile char*)KERNBASE = 0;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != -1){
+    printf("%s: child wasn't killed\n", s);
+    exit(1);
+  }
+
+  // "pid=<pid>\n"
+  p = want + sizeof(want);
+  *--p = '\0';
+  *--p = '\n';
+  for(i = pid; i > 0; i /= 10)
+    *--p = '0' + i % 10;
+  p -= 4;
+  memmove(p, "pid=", 4);
+
+  n = dmesg(buf, 512);
+  if(n <= 0 || n > 512){
+    printf("%s: dmesg returned %d\n", s, n);
+    exit(1);
+  }
+  for(i = 0; i + strlen(p) <= n; i++)
+    if(memcmp(buf + i, p, strlen(p)) == 0)
+      return;
+  printf("%s: fault not in the log\n", s);
+  exit(1);
+}
+
+// a shared memory segment, seen by a parent and its child.
+void
+shmtest(char *s)
+{
+  int *a, *b, pid, xstatus;
+
+  if(shmmap(77, SHMMAX + 1) != (void*)-1 || shmmap(78, 0) != (void*)-1){
+    printf("%s: bad shmmap succeeded\n", s);
+    exit(1);
+  }
+  a = shmmap(77, 2*PGSIZE);
+  if(a == (void*)-1 || a[0] != 0 || a[2*PGSIZE/sizeof(int) - 1] != 0){
+    printf("%s: shmmap failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    // already mapped, by fork().
+    if(shmmap(77, 0) != a)
+      exit(1);
+    a[0] = 1234;
+    a[PGSIZE/sizeof(int)] = 5678;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[0] != 1234 || a[PGSIZE/sizeof(int)] != 5678){
+    printf("%s: child's writes not seen\n", s);
+    exit(1);
+  }
+  if(shmunmap(77) != 0 || shmunmap(77) != -1){
+    printf("%s: shmunmap failed\n", s);
+    exit(1);
+  }
+  // the last unmap freed it, so this is a new, zeroed segment.
+  b = shmmap(77, PGSIZE);
+  if(b == (void*)-1 || b[0] != 0){
+    printf("%s: segment not freed\n", s);
+    exit(1);
+  }
+  shmunmap(77);
+}
+
 // simple fork and pipe read/write
 
 void
@@ -2076,6 +2778,137 @@ sbrkmuch(char *s)
   }
 }
 
+// grow by a large, megapage-aligned amount so that the kernel
+// can map it with megapages, then check that fork() copies it
+// and that shrinking into the middle of a megapage keeps the rest.
+void
+megapages(char *s)
+{
+  enum { MEGA=2*1024*1024 };
+  char *a, *p;
+  int pid, xstatus, pad = 0;
+
+  a = sbrk(0);
+  if((uint64)a % MEGA)
+    pad = MEGA - (uint64)a % MEGA;
+  sbrk(pad);
+  a = sbrk(2*MEGA);
+  if(a == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + 2*MEGA; p += PGSIZE)
+    *p = (p - a) / PGSIZE;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(p = a; p < a + 2*MEGA; p += PGSIZE){
+      if(*p != (char)((p - a) / PGSIZE)){
+        printf("%s: child sees wrong data at %p\n", s, p);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+
+  if(sbrk(-3*PGSIZE) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk could not deallocate\n", s);
+    exit(1);
+  }
+  for(p = a; p < a + 2*MEGA - 3*PGSIZE; p += PGSIZE){
+    if(*p != (char)((p - a) / PGSIZE)){
+      printf("%s: lost data at %p after shrink\n", s, p);
+      exit(1);
+    }
+  }
+  sbrk(-(2*MEGA - 3*PGSIZE));
+  sbrk(-pad);
+}
+
+// does sysinfo() see memory being allocated and freed,
+// and does procinfo() report this process's resident size?
+void
+meminfo(char *s)
+{
+  struct sysinfo si0, si1;
+  static struct procinfo pi[NPROC];
+  int i, n, pid = getpid();
+
+  if(sysinfo(&si0) < 0){
+    printf("%s: sysinfo failed\n", s);
+    exit(1);
+  }
+  if(si0.freemem > si0.totalmem || si0.nproc < 1){
+    printf("%s: sysinfo nonsense\n", s);
+    exit(1);
+  }
+  if(sbrk(64*PGSIZE) == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  sysinfo(&si1);
+  if(si1.freemem > si0.freemem - 64*PGSIZE){
+    printf("%s: freemem did not drop\n", s);
+    exit(1);
+  }
+  n = procinfo(pi, NPROC);
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid)
+      break;
+  if(i == n || pi[i].rss < 64*PGSIZE){
+    printf("%s: procinfo missing or wrong rss\n", s);
+    exit(1);
+  }
+  sbrk(-64*PGSIZE);
+}
+
+// allocate more memory than is free, so that pages must go out
+// to swap, and check that they all come back intact.
+void
+swapping(char *s)
+{
+  struct sysinfo si;
+  char *a, *p;
+  uint64 n;
+  int pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    sysinfo(&si);
+    n = si.freemem + 1024*1024;
+    a = sbrk(0);
+    for(p = a; p < a + n; p += 16*PGSIZE){
+      if(sbrk(16*PGSIZE) == (char*)0xffffffffffffffffL){
+        printf("%s: sbrk failed after %d bytes\n", s, p - a);
+        exit(1);
+      }
+      for(char *q = p; q < p + 16*PGSIZE; q += PGSIZE)
+        *(uint64*)q = (uint64)q;
+    }
+    for(p = a; p < a + n; p += PGSIZE){
+      if(*(uint64*)p != (uint64)p){
+        printf("%s: page %p came back wrong\n", s, p);
+        exit(1);
+      }
+    }
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+}
+
 // can we read the kernel's memory?
 void
 kernmem(char *s)
@@ -2666,11 +3499,16 @@ main(int argc, char *argv[])
     {fourfiles, "fourfiles"},
     {sharedfd, "sharedfd"},
     {exectest, "exectest"},
+    {spawntest, "spawntest"},
+    {shmtest, "shmtest"},
     {bigargtest, "bigargtest"},
     {bigwrite, "bigwrite"},
     {bsstest, "bsstest"},
     {sbrkbasic, "sbrkbasic"},
     {sbrkmuch, "sbrkmuch"},
+    {megapages, "megapages"},
+    {meminfo, "meminfo"},
+    {swapping, "swapping"},
     {kernmem, "kernmem"},
     {sbrkfail, "sbrkfail"},
     {sbrkarg, "sbrkarg"},
@@ -2685,6 +3523,18 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipebig, "pipebig"},
+    {splicetest, "splicetest"},
+    {polltest, "polltest"},
+    {evqtest, "evqtest"},
+    {uringtest, "uringtest"},
+    {stdiotest, "stdiotest"},
+    {dmesgtest, "dmesgtest"},
+    {sysregs, "sysregs"},
+    {upagetest, "upagetest"},
+    {nanosleeptest, "nanosleeptest"},
+    {affinitytest, "affinitytest"},
+    {schedlattest, "schedlattest"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
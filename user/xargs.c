@@ -63,13 +63,12 @@ main(int argc, char *argv[]){
         nargc = split(command, nargc, nargv);
         
     }
-    int pid = fork();
-    if (pid == 0){
-        exec(nargv[0], nargv);
-    }
-    else{
-        wait(0);
+    nargv[nargc] = 0;
+    if (spawn(nargv[0], nargv, 0, 0) < 0){
+        fprintf(2, "xargs: exec %s failed\n", nargv[0]);
+        exit(1);
     }
+    wait(0);
 
     exit(0);
 }
\ No newline at end of file